@@ -7,32 +7,192 @@
 #include <assert.h>
 #include <SDL2/SDL_ttf.h>
 
+#include <stdio.h>
 #include <string.h>
 #include "renderer.h"
+#include "sdffont.h"
+#include "loader.h"
+#include "images.h"
 #include "atlas.inl"
 
 #define BUFFER_SIZE 16384
+#define MAX_BATCHES 1024
+#define MAX_TEXT_TEXTURES 256
+#define MAX_TEXT_CACHE 128
+#define MAX_LAYERS 64
+#define LAYER_STACK_SIZE 32
+#define DEFAULT_LAYER_BUDGET (8 << 20) // bytes
+#define MAX_SDF_FONTS 8
+#define MAX_FONT_LOADS 16
+#define MAX_IMAGE_PAGES 32
+#define IMAGE_PAGE_SIZE 1024 // images up to a quarter of it on both sides share pages
+#define DEFAULT_IMAGE_BUDGET (32 << 20) // bytes
+#define UPLOAD_SLOTS 4 // pixel-unpack buffers, each filled at most once a frame
+#define UPLOAD_SLOT_BYTES (1 << 20)
+#define MAX_UPLOAD_BANDS 64 // image bands taken from one buffer
 
 
 // Vertex structure for interleaved data
 typedef struct {
     float pos[2];
-    float tex[2];
-    unsigned char color[4];
+    float tex[2]; // for a box, the position inside it
+    unsigned char color[4]; // for a box, the fill
+    unsigned char border[4];
+    short box[4]; // width, height, corner radius, border width; -1 border width for textured quads,
+                  // -2 for distance-field glyphs with the edge value in place of the radius
 } Vertex;
 
-static Vertex vertices[BUFFER_SIZE * 4];
-static GLushort indices[BUFFER_SIZE * 6];
+#define TEXTURED {0, 0, 0, 0}, {0, 0, 0, -1}
+
+static Vertex *vertices; // grown with the frames, see reserve_vertices
+static GLushort *indices;
+static int vertex_quads; // capacity of vertices, indices and resident
 
 static int width = 800;
 static int height = 480;
 static int buf_idx;
+static mu_Vec2 translation; // MU_COMMAND_TRANSLATE, applied to quads and clip rects
 
 static SDL_Window *window;
+static SDL_GLContext gl_context;
+static SDL_mutex *ttf_lock; // fonts are measured on the UI thread and rasterized on the render thread
 static GLuint shader_program;
 static GLuint vao, vbo, ebo;
 static GLuint texture;
 static GLint u_projection;
+static GLint u_rgba;
+static int buffer_quads; // vbo and ebo capacity, grown to what frames use
+static const char *program_cache; // file the linked program is kept in, see load_program
+static Uint64 first_present; // performance counter at the first r_present
+static int target_w = 800, target_h = 480; // size of the framebuffer drawn to
+
+/* retained mode: a frame's quads are collected in draw order and compared
+ * with the copy resident in vbo. Only runs of quads that changed are uploaded,
+ * then the frame is drawn from vbo with one call per clip rect and texture. */
+typedef struct {
+    int first, count; // quads
+    mu_Rect clip;
+    GLuint texture;
+    int rgba; // premultiplied: a layer or an image
+} Batch;
+
+static int retained;
+static int indices_ready; // the index pattern never changes in retained mode
+static Vertex *resident; // what vbo holds
+static int resident_quads;
+static Batch batches[MAX_BATCHES];
+static int batch_count;
+static mu_Rect cur_clip;
+static GLuint text_textures[MAX_TEXT_TEXTURES]; // freed once the frame is drawn
+static int text_texture_count;
+
+/* rasterized strings, looked up by the hash the text command carries, so a
+ * label that is drawn again is not rendered by SDL_ttf and uploaded every frame */
+typedef struct {
+    mu_Id hash;
+    int len;
+    char *text; // a copy, compared on a hit since different strings can share a hash
+    mu_Font font;
+    mu_Color color;
+    GLuint texture;
+    int w, h;
+    int last_used; // frame
+} TextEntry;
+
+static TextEntry text_cache[MAX_TEXT_CACHE];
+static int text_cache_count;
+
+/* layers: MU_COMMAND_LAYER subtrees rendered into a texture of their own and
+ * composited as one quad until their version changes. Textures are kept
+ * within layer_budget bytes, least recently used ones are evicted first. */
+typedef struct {
+    mu_Id id, version;
+    GLuint fbo, texture;
+    int w, h;
+    int last_used; // frame
+    int incomplete; // drew images that were not uploaded yet, not reused
+} Layer;
+
+/* what r_end_layer restores */
+typedef struct {
+    Layer *layer; // being rendered, NULL when the layer is drawn through
+    mu_Vec2 translation;
+    mu_Rect scissor, bound;
+    mu_Rect rect, clip; // where the layer is composited, rect is translated
+} LayerFrame;
+
+static Layer layers[MAX_LAYERS];
+static int layer_count;
+static int layer_bytes;
+static int layer_budget = DEFAULT_LAYER_BUDGET;
+static LayerFrame layer_stack[LAYER_STACK_SIZE];
+static int layer_depth;
+static int recording; // a layer texture is bound as the target
+static mu_Rect bound; // every clip rect is limited to this within a layer drawn through
+static int frame_count;
+static r_LayerStats layer_stats;
+static r_DrawStats draw_stats;
+static int clip_target_h; // target_h when cur_clip was applied
+
+/* distance-field fonts and their atlas textures, uploaded when first drawn */
+static sdf_Font sdf_fonts[MAX_SDF_FONTS];
+static GLuint sdf_textures[MAX_SDF_FONTS];
+static int sdf_font_count;
+
+/* fonts loaded on the loader thread, see r_load_font_async */
+typedef struct {
+    mu_Font *handle; // a TTF font is stored here when it is open
+    sdf_Font *sdf; // a distance-field font is marked ready when it is built
+    char path[512];
+    unsigned char size;
+} FontLoad;
+
+static FontLoad font_loads[MAX_FONT_LOADS];
+static int font_load_count;
+static SDL_atomic_t font_generation; // fonts the loader thread finished
+
+/* images: decoded on loader threads (images.c) and streamed into textures
+ * here. Images up to IMAGE_PAGE_SIZE / 4 on both sides are packed into shared
+ * pages, larger ones get a texture of their own; both are kept within
+ * image_budget bytes, the least recently drawn are evicted first. Pixels go
+ * through a ring of pixel-unpack buffers, each filled once a frame and only
+ * when the GPU is done reading it, so the frame waits on neither decoding nor
+ * uploads. An image is drawn once all of its rows are uploaded. */
+typedef struct {
+    GLuint texture; // its page's or its own, 0 when not placed
+    int page; // -1 for a texture of its own
+    int x, y, w, h; // in the texture
+    int rows; // uploaded, h when it can be drawn
+    int last_used; // frame
+    int queued; // in image_queue, and holding the image's pixels
+} ImageSlot;
+
+typedef struct {
+    GLuint texture; // 0 when the page is free
+    int pen_x, pen_y, row_h; // shelf packing
+    int last_used; // frame any of its images was drawn in
+} ImagePage;
+
+typedef struct {
+    GLuint pbo;
+    GLsync fence; // until the GPU has read pbo
+} UploadSlot;
+
+static ImageSlot image_slots[IMG_MAX_IMAGES];
+static img_Image *image_queue[IMG_MAX_IMAGES]; // drawn while not uploaded
+static int image_queue_count;
+static ImagePage image_pages[MAX_IMAGE_PAGES];
+static int image_bytes;
+static int image_budget = DEFAULT_IMAGE_BUDGET;
+static UploadSlot upload_slots[UPLOAD_SLOTS];
+static int upload_next;
+static int uploads_ready; // 1 with the buffer ring, -1 when the driver lacks it
+static r_ImageStats image_stats;
+static PFNGLMAPBUFFERRANGEEXTPROC map_buffer_range;
+static PFNGLUNMAPBUFFEROESPROC unmap_buffer;
+static PFNGLFENCESYNCAPPLEPROC fence_sync;
+static PFNGLCLIENTWAITSYNCAPPLEPROC client_wait_sync;
+static PFNGLDELETESYNCAPPLEPROC delete_sync;
 
 // Vertex shader
 static const char *vertex_shader_src = 
@@ -41,26 +201,55 @@ static const char *vertex_shader_src =
 "layout(location = 0) in vec2 a_pos;\n"
 "layout(location = 1) in vec2 a_tex;\n"
 "layout(location = 2) in vec4 a_color;\n"
+"layout(location = 3) in vec4 a_border;\n"
+"layout(location = 4) in vec4 a_box;\n"
 "uniform mat4 u_projection;\n"
 "out vec2 v_tex;\n"
 "out vec4 v_color;\n"
+"out vec4 v_border;\n"
+"flat out vec4 v_box;\n"
 "void main() {\n"
 "  v_tex = a_tex;\n"
 "  v_color = a_color;\n"
+"  v_border = a_border;\n"
+"  v_box = a_box;\n"
 "  gl_Position = u_projection * vec4(a_pos, 0.0, 1.0);\n"
 "}\n";
 
 // Fragment shader
 static const char *fragment_shader_src =
 "#version 310 es\n"
-"precision mediump float;\n"
+"precision highp float;\n"
 "in vec2 v_tex;\n"
 "in vec4 v_color;\n"
+"in vec4 v_border;\n"
+"flat in vec4 v_box;\n"
 "uniform sampler2D u_texture;\n"
+"uniform int u_rgba;\n"
 "out vec4 fragColor;\n"
 "void main() {\n"
-"  float alpha = texture(u_texture, v_tex).a;\n"
-"  fragColor = v_color * alpha;\n"
+"  if (v_box.w < -1.5) {\n"
+"    // distance-field glyph: the ramp across one pixel around the edge value\n"
+"    float d = texture(u_texture, v_tex).a;\n"
+"    float edge = v_box.z / 255.0;\n"
+"    float ramp = max(fwidth(d) * 0.5, 1.0 / 255.0);\n"
+"    fragColor = vec4(v_color.rgb, v_color.a * smoothstep(edge - ramp, edge + ramp, d));\n"
+"    return;\n"
+"  }\n"
+"  if (v_box.w < 0.0) {\n"
+"    vec4 t = texture(u_texture, v_tex);\n"
+"    fragColor = u_rgba != 0 ? t * v_color.a : v_color * t.a;\n"
+"    return;\n"
+"  }\n"
+"  // box: signed distance to the rounded outer edge, the border lies within\n"
+"  vec2 half_size = v_box.xy * 0.5;\n"
+"  float r = min(v_box.z, min(half_size.x, half_size.y));\n"
+"  vec2 q = abs(v_tex - half_size) - half_size + r;\n"
+"  float d = length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - r;\n"
+"  float outer = clamp(0.5 - d, 0.0, 1.0);\n"
+"  float inner = clamp(0.5 - d - v_box.w, 0.0, 1.0);\n"
+"  vec4 c = mix(v_border, v_color, inner);\n"
+"  fragColor = vec4(c.rgb, c.a * outer);\n"
 "}\n";
 
 static GLuint compile_shader(GLenum type, const char *source) {
@@ -75,6 +264,125 @@ static GLuint compile_shader(GLenum type, const char *source) {
     return shader;
 }
 
+// Identifies the program a binary was saved from: the shader sources and the
+// driver that compiled them.
+static unsigned program_key(void) {
+    const char *parts[] = {
+        vertex_shader_src, fragment_shader_src,
+        (const char *)glGetString(GL_VENDOR), (const char *)glGetString(GL_RENDERER),
+        (const char *)glGetString(GL_VERSION)
+    };
+    unsigned h = 2166136261u;
+    for (int i = 0; i < 5; i++) {
+        for (const char *p = parts[i]; p && *p; p++) h = (h ^ (unsigned char)*p) * 16777619u;
+        h = (h ^ 0xff) * 16777619u; // separator
+    }
+    return h;
+}
+
+typedef struct {
+    char magic[4]; // "MUPB"
+    unsigned key; // program_key
+    GLenum format;
+    GLint length; // bytes that follow
+} ProgramCacheHeader;
+
+static PFNGLGETPROGRAMBINARYOESPROC get_program_binary;
+static PFNGLPROGRAMBINARYOESPROC program_binary;
+
+// The program from the cache file, 0 when there is none, it was saved by
+// other sources or another driver, or the driver rejects it.
+static GLuint load_cached_program(unsigned key) {
+    ProgramCacheHeader header;
+    GLuint program = 0;
+    FILE *fp = fopen(program_cache, "rb");
+    if (!fp) return 0;
+    if (fread(&header, sizeof(header), 1, fp) == 1 && !memcmp(header.magic, "MUPB", 4)
+        && header.key == key && header.length > 0) {
+        void *binary = malloc(header.length);
+        if (binary && fread(binary, 1, header.length, fp) == (size_t)header.length) {
+            GLint linked = 0;
+            program = glCreateProgram();
+            program_binary(program, header.format, binary, header.length);
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            if (!linked) {
+                glDeleteProgram(program);
+                program = 0;
+            }
+        }
+        free(binary);
+    }
+    fclose(fp);
+    while (glGetError() != GL_NO_ERROR) {} // a rejected format is not an error here
+    return program;
+}
+
+static void save_program(GLuint program, unsigned key) {
+    ProgramCacheHeader header = { {'M', 'U', 'P', 'B'}, key, 0, 0 };
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &header.length);
+    if (header.length <= 0) return;
+    void *binary = malloc(header.length);
+    if (!binary) return;
+    get_program_binary(program, header.length, NULL, &header.format, binary);
+    FILE *fp = glGetError() == GL_NO_ERROR ? fopen(program_cache, "wb") : NULL;
+    if (fp) {
+        if (fwrite(&header, sizeof(header), 1, fp) != 1 || fwrite(binary, 1, header.length, fp) != (size_t)header.length) {
+            fclose(fp);
+            remove(program_cache); // never leave a torn file behind
+            fp = NULL;
+        }
+    }
+    if (fp) fclose(fp);
+    free(binary);
+}
+
+// Links the program from the cache when possible, else compiles it from
+// source and stores the binary for the next start.
+static GLuint load_program(void) {
+    GLint formats = 0;
+    unsigned key = 0;
+    if (program_cache) {
+        get_program_binary = (PFNGLGETPROGRAMBINARYOESPROC)SDL_GL_GetProcAddress("glGetProgramBinary");
+        program_binary = (PFNGLPROGRAMBINARYOESPROC)SDL_GL_GetProcAddress("glProgramBinary");
+        if (!get_program_binary) { // ES 2 drivers with OES_get_program_binary
+            get_program_binary = (PFNGLGETPROGRAMBINARYOESPROC)SDL_GL_GetProcAddress("glGetProgramBinaryOES");
+            program_binary = (PFNGLPROGRAMBINARYOESPROC)SDL_GL_GetProcAddress("glProgramBinaryOES");
+        }
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+    }
+    int cached = get_program_binary && program_binary && formats > 0;
+    if (cached) {
+        key = program_key();
+        GLuint program = load_cached_program(key);
+        if (program) return program;
+    }
+
+    GLuint vs = compile_shader(GL_VERTEX_SHADER, vertex_shader_src);
+    GLuint fs = compile_shader(GL_FRAGMENT_SHADER, fragment_shader_src);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    glLinkProgram(program);
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    assert(success);
+
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    if (cached) save_program(program, key);
+    return program;
+}
+
+// Keeps linked shaders in path so later starts skip compiling them; call
+// before r_init. A stale or foreign file is ignored and replaced.
+void r_set_program_cache(const char *path) {
+    program_cache = path;
+}
+
+// Only what the first frame needs: buffers start empty and grow with use,
+// the UI atlas is uploaded when first drawn from, SDL_ttf starts with the
+// first TTF font.
 void r_init(void) {
     // Init SDL window
     window = SDL_CreateWindow(
@@ -84,28 +392,16 @@ void r_init(void) {
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
-    SDL_GL_CreateContext(window);
+    gl_context = SDL_GL_CreateContext(window);
 
-    int result = TTF_Init();
-    assert(result == 0 && "TTF_Init failed");
+    ttf_lock = SDL_CreateMutex(); // SDL_ttf is initialized by the first TTF font
+
+    shader_program = load_program();
 
-    // Create shaders
-    GLuint vs = compile_shader(GL_VERTEX_SHADER, vertex_shader_src);
-    GLuint fs = compile_shader(GL_FRAGMENT_SHADER, fragment_shader_src);
-    
-    shader_program = glCreateProgram();
-    glAttachShader(shader_program, vs);
-    glAttachShader(shader_program, fs);
-    glLinkProgram(shader_program);
-    
-    GLint success;
-    glGetProgramiv(shader_program, GL_LINK_STATUS, &success);
-    assert(success);
-    
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-    
     u_projection = glGetUniformLocation(shader_program, "u_projection");
+    u_rgba = glGetUniformLocation(shader_program, "u_rgba");
+    glUseProgram(shader_program);
+    glUniform1i(u_rgba, 0);
 
     // Create VAO and buffers
     glGenVertexArrays(1, &vao);
@@ -115,10 +411,7 @@ void r_init(void) {
     glBindVertexArray(vao);
     
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), NULL, GL_DYNAMIC_DRAW);
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo); // storage comes with reserve_quads
     
     // Position attribute
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, pos));
@@ -132,18 +425,18 @@ void r_init(void) {
     glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, color));
     glEnableVertexAttribArray(2);
 
-    // Create texture
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, ATLAS_WIDTH, ATLAS_HEIGHT, 0,
-                 GL_ALPHA, GL_UNSIGNED_BYTE, atlas_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    // Box attributes
+    glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, border));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(4, 4, GL_SHORT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, box));
+    glEnableVertexAttribArray(4);
 
     // Set GL state
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glEnable(GL_SCISSOR_TEST);
+    cur_clip = mu_rect(0, 0, width, height);
+    bound = cur_clip;
     
     assert(glGetError() == GL_NO_ERROR);
         // Unbind VAO first (this also unbinds the VBO from VAO state)
@@ -151,20 +444,81 @@ void r_init(void) {
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-static void textflush(void) {
-    if (buf_idx == 0) return;
-    glUseProgram(shader_program);
-    
-    // Set projection matrix (orthographic)
+// The UI atlas (atlas.inl), uploaded the first time a quad samples it.
+static GLuint ui_atlas(void) {
+    if (!texture) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, ATLAS_WIDTH, ATLAS_HEIGHT, 0,
+                     GL_ALPHA, GL_UNSIGNED_BYTE, atlas_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    return texture;
+}
+
+// Grows the CPU side arrays to hold quads, doubling like vbo and ebo; the
+// quads pushed so far are kept. Returns 0 when out of memory.
+static int reserve_vertices(int quads) {
+    if (quads <= vertex_quads) return 1;
+    int n = vertex_quads ? vertex_quads : 256;
+    while (n < quads) n *= 2;
+    if (n > BUFFER_SIZE) n = BUFFER_SIZE;
+    Vertex *v = realloc(vertices, n * 4 * sizeof(Vertex));
+    if (v) vertices = v;
+    GLushort *i = realloc(indices, n * 6 * sizeof(GLushort));
+    if (i) indices = i;
+    Vertex *r = realloc(resident, n * 4 * sizeof(Vertex));
+    if (r) resident = r;
+    if (!v || !i || !r) return 0;
+    vertex_quads = n;
+    return 1;
+}
+
+// Grows vbo and ebo to hold quads, doubling; their contents are lost, so
+// retained mode uploads everything again. Expects vao to be bound.
+static void reserve_quads(int quads) {
+    if (quads <= buffer_quads) return;
+    int n = buffer_quads ? buffer_quads : 256;
+    while (n < quads) n *= 2;
+    if (n > BUFFER_SIZE) n = BUFFER_SIZE;
+    if (!reserve_vertices(n)) n = vertex_quads; // still holds the quads pushed
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, n * 4 * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, n * 6 * sizeof(GLushort), NULL, GL_DYNAMIC_DRAW);
+    buffer_quads = n;
+    resident_quads = 0;
+    indices_ready = 0;
+}
+
+// Orthographic projection onto the current target, y pointing down.
+static void set_projection(void) {
     float proj[16] = {
-        2.0f/width, 0, 0, 0,
-        0, -2.0f/height, 0, 0,
+        2.0f/target_w, 0, 0, 0,
+        0, -2.0f/target_h, 0, 0,
         0, 0, -1, 0,
         -1, 1, 0, 1
     };
     glUniformMatrix4fv(u_projection, 1, GL_FALSE, proj);
+}
+
+// Layer textures hold premultiplied color and are blended as such.
+static void set_rgba(int on) {
+    glUniform1i(u_rgba, on);
+    if (on) glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    else if (recording) glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    else glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+static void textflush(int rgba) {
+    if (buf_idx == 0) return;
+    glUseProgram(shader_program);
+    
+    set_projection();
 
     glBindVertexArray(vao);
+    reserve_quads(buf_idx);
     
     // Upload vertex data
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -174,27 +528,27 @@ static void textflush(void) {
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
     glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, buf_idx * 6 * sizeof(GLushort), indices);
     
+    if (rgba) set_rgba(1);
     glDrawElements(GL_TRIANGLES, buf_idx * 6, GL_UNSIGNED_SHORT, 0);
+    draw_stats.flushes++;
+    if (rgba) set_rgba(0);
 
     buf_idx = 0;
 }
 
 
+static void retained_flush(void);
+
 static void flush(void) {
+    if (retained) { retained_flush(); return; }
     if (buf_idx == 0) return;
     glUseProgram(shader_program);
     
-    // Set projection matrix (orthographic)
-    float proj[16] = {
-        2.0f/width, 0, 0, 0,
-        0, -2.0f/height, 0, 0,
-        0, 0, -1, 0,
-        -1, 1, 0, 1
-    };
-    glUniformMatrix4fv(u_projection, 1, GL_FALSE, proj);
+    set_projection();
 
     glBindVertexArray(vao);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    reserve_quads(buf_idx);
+    glBindTexture(GL_TEXTURE_2D, ui_atlas());
     
     // Upload vertex data
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -205,12 +559,32 @@ static void flush(void) {
     glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, buf_idx * 6 * sizeof(GLushort), indices);
     
     glDrawElements(GL_TRIANGLES, buf_idx * 6, GL_UNSIGNED_SHORT, 0);
+    draw_stats.flushes++;
 
     buf_idx = 0;
 }
 
+/* starts a new batch when the clip rect or texture of the next quad differ */
+static void batch_quad(GLuint tex, int rgba) {
+    Batch *b = batch_count ? &batches[batch_count - 1] : NULL;
+    if (!b || b->texture != tex || memcmp(&b->clip, &cur_clip, sizeof(mu_Rect))) {
+        if (batch_count == MAX_BATCHES) { flush(); }
+        b = &batches[batch_count++];
+        b->first = buf_idx;
+        b->count = 0;
+        b->clip = cur_clip;
+        b->texture = tex;
+        b->rgba = rgba;
+    }
+    b->count++;
+}
+
 static void push_quad(mu_Rect dst, mu_Rect src, mu_Color color) {
+    dst.x += translation.x;
+    dst.y += translation.y;
     if (buf_idx == BUFFER_SIZE) flush();
+    if (!reserve_vertices(buf_idx + 1)) return; // out of memory, the quad is dropped
+    if (retained) batch_quad(ui_atlas(), 0);
 
     int vi = buf_idx * 4;
     int ii = buf_idx * 6;
@@ -222,10 +596,10 @@ static void push_quad(mu_Rect dst, mu_Rect src, mu_Color color) {
     float ty1 = (src.y + src.h) / (float)ATLAS_HEIGHT;
 
     // Vertices (counter-clockwise)
-    vertices[vi + 0] = (Vertex){{dst.x, dst.y}, {tx0, ty0}, {color.r, color.g, color.b, color.a}};
-    vertices[vi + 1] = (Vertex){{dst.x + dst.w, dst.y}, {tx1, ty0}, {color.r, color.g, color.b, color.a}};
-    vertices[vi + 2] = (Vertex){{dst.x + dst.w, dst.y + dst.h}, {tx1, ty1}, {color.r, color.g, color.b, color.a}};
-    vertices[vi + 3] = (Vertex){{dst.x, dst.y + dst.h}, {tx0, ty1}, {color.r, color.g, color.b, color.a}};
+    vertices[vi + 0] = (Vertex){{dst.x, dst.y}, {tx0, ty0}, {color.r, color.g, color.b, color.a}, TEXTURED};
+    vertices[vi + 1] = (Vertex){{dst.x + dst.w, dst.y}, {tx1, ty0}, {color.r, color.g, color.b, color.a}, TEXTURED};
+    vertices[vi + 2] = (Vertex){{dst.x + dst.w, dst.y + dst.h}, {tx1, ty1}, {color.r, color.g, color.b, color.a}, TEXTURED};
+    vertices[vi + 3] = (Vertex){{dst.x, dst.y + dst.h}, {tx0, ty1}, {color.r, color.g, color.b, color.a}, TEXTURED};
 
     // Indices (two triangles)
     GLushort base = buf_idx * 4;
@@ -243,24 +617,190 @@ void r_draw_rect(mu_Rect rect, mu_Color color) {
     push_quad(rect, atlas[ATLAS_WHITE], color);
 }
 
+// One quad, the fragment shader draws fill, border and rounded corners.
+void r_draw_box(mu_Rect rect, mu_Color color, mu_Color border, int border_width, int radius) {
+    rect.x += translation.x;
+    rect.y += translation.y;
+    if (buf_idx == BUFFER_SIZE) flush();
+    if (!reserve_vertices(buf_idx + 1)) return;
+    if (retained) batch_quad(ui_atlas(), 0);
+
+    int vi = buf_idx * 4;
+    int ii = buf_idx * 6;
+    Vertex v = {
+        {0, 0}, {0, 0},
+        {color.r, color.g, color.b, color.a},
+        {border.r, border.g, border.b, border.a},
+        {rect.w, rect.h, radius, border_width}
+    };
+    for (int i = 0; i < 4; i++) {
+        int right = i == 1 || i == 2;
+        int bottom = i >= 2;
+        v.pos[0] = rect.x + right * rect.w;
+        v.pos[1] = rect.y + bottom * rect.h;
+        v.tex[0] = right * rect.w;
+        v.tex[1] = bottom * rect.h;
+        vertices[vi + i] = v;
+    }
+
+    GLushort base = buf_idx * 4;
+    indices[ii + 0] = base + 0;
+    indices[ii + 1] = base + 1;
+    indices[ii + 2] = base + 2;
+    indices[ii + 3] = base + 0;
+    indices[ii + 4] = base + 2;
+    indices[ii + 5] = base + 3;
+
+    buf_idx++;
+}
+
+
+// FreeType is only started for fonts rasterized at runtime, not for packs.
+static void init_ttf(void) {
+    static int ready;
+    if (ready) return;
+    int result = TTF_Init();
+    assert(result == 0 && "TTF_Init failed");
+    ready = 1;
+}
 
 void r_load_font(mu_Font *font, const char* path, unsigned char size) {
-    *font = TTF_OpenFont(path, size);
-    assert(font && "Failed to load font");
+    SDL_LockMutex(ttf_lock);
+    init_ttf();
+    SDL_AtomicSetPtr(font, TTF_OpenFont(path, size));
+    SDL_UnlockMutex(ttf_lock);
+    assert(*font && "Failed to load font");
+
+}
+
+// Rasterizes the font once into a distance-field atlas; *font draws it at size.
+void r_load_sdf_font(mu_Font *font, const char *path, unsigned char size) {
+    assert(sdf_font_count < MAX_SDF_FONTS && "Too many distance-field fonts");
+    sdf_Font *f = &sdf_fonts[sdf_font_count];
+    SDL_LockMutex(ttf_lock);
+    init_ttf();
+    int ok = sdf_load(f, path, size, NULL);
+    SDL_UnlockMutex(ttf_lock);
+    assert(ok && "Failed to load font");
+    sdf_font_count++;
+    *font = sdf_face(f, size, 0);
+}
+
+// A font baked by tools/fontbake, mapped rather than read; the atlas is
+// uploaded when the font is first drawn. *font draws it at size.
+void r_load_font_pack(mu_Font *font, const char *path, const char *name, unsigned char size) {
+    assert(sdf_font_count < MAX_SDF_FONTS && "Too many distance-field fonts");
+    sdf_Font *f = &sdf_fonts[sdf_font_count];
+    int ok = sdf_map(f, path, name);
+    assert(ok && "Failed to map font pack");
+    sdf_font_count++;
+    *font = sdf_face(f, size, 0);
+}
+
+static void load_font_task(void *data) {
+    FontLoad *l = data;
+    SDL_LockMutex(ttf_lock); // held while an atlas is built, other TTF text waits
+    init_ttf();
+    if (l->sdf) {
+        if (sdf_load(l->sdf, l->path, l->size, NULL)) {
+            SDL_AtomicIncRef(&font_generation);
+        } else {
+            SDL_Log("Failed to load font %s", l->path);
+        }
+    } else {
+        TTF_Font *ttf = TTF_OpenFont(l->path, l->size);
+        if (ttf) {
+            // rasterize the printable glyphs into SDL_ttf's cache ahead of the first label
+            char ascii[SDF_GLYPHS + 1];
+            for (int i = 0; i < SDF_GLYPHS; i++) ascii[i] = SDF_FIRST_GLYPH + i;
+            ascii[SDF_GLYPHS] = '\0';
+            SDL_FreeSurface(TTF_RenderUTF8_Blended(ttf, ascii, (SDL_Color){255, 255, 255, 255}));
+            SDL_AtomicSetPtr(l->handle, ttf);
+            SDL_AtomicIncRef(&font_generation);
+        } else {
+            SDL_Log("Failed to load font %s", l->path);
+        }
+    }
+    SDL_UnlockMutex(ttf_lock);
+}
+
+static FontLoad *new_font_load(const char *path, unsigned char size) {
+    assert(font_load_count < MAX_FONT_LOADS && "Too many font loads");
+    FontLoad *l = &font_loads[font_load_count++];
+    SDL_strlcpy(l->path, path, sizeof(l->path));
+    l->size = size;
+    return l;
+}
+
+// Returns at once and opens the font on the loader thread (ld_init). Text in
+// the font is drawn and measured with the built-in atlas font until then.
+void r_load_font_async(mu_Font *font, const char *path, unsigned char size) {
+    FontLoad *l = new_font_load(path, size);
+    SDL_AtomicSetPtr(font, NULL);
+    l->handle = font;
+    ld_submit(load_font_task, l);
+}
+
+// r_load_sdf_font on the loader thread; *font is usable at once.
+void r_load_sdf_font_async(mu_Font *font, const char *path, unsigned char size) {
+    assert(sdf_font_count < MAX_SDF_FONTS && "Too many distance-field fonts");
+    FontLoad *l = new_font_load(path, size);
+    l->sdf = &sdf_fonts[sdf_font_count++];
+    *font = sdf_face(l->sdf, size, 0);
+    ld_submit(load_font_task, l);
+}
+
+// Changes whenever an asynchronously loaded font becomes ready and text
+// measures differently; the host hands it to ctx->font_generation.
+int r_font_generation(void) {
+    return SDL_AtomicGet(&font_generation);
+}
+
+// What a handle draws with: a distance-field face whose atlas is built, or a
+// TTF font that is open. With neither the built-in atlas font stands in.
+static sdf_Face *ready_face(mu_Font font) {
+    if (!sdf_is_face(font)) return NULL;
+    sdf_Face *face = font;
+    return sdf_ready(face->font) ? face : NULL;
+}
+
+static TTF_Font *ttf_font(mu_Font font) {
+    return font && !sdf_is_face(font) ? SDL_AtomicGetPtr(font) : NULL;
+}
+
+// The same distance-field atlas at another size and weight; other fonts have
+// one size only and are returned as they are.
+mu_Font r_font_face(mu_Font font, float size, float weight) {
+    if (!sdf_is_face(font)) return font;
+    sdf_Face *face = sdf_face(((sdf_Face *)font)->font, size, weight);
+    return face ? face : font;
+}
 
+// Makes the GL context current on the calling thread, e.g. a render thread.
+void r_acquire_context(void) {
+    SDL_GL_MakeCurrent(window, gl_context);
 }
 
-static void push_raw_quad(mu_Rect dst, float uv[8], mu_Color color) {
+// Detaches the GL context so another thread can acquire it.
+void r_release_context(void) {
+    SDL_GL_MakeCurrent(window, NULL);
+}
+
+static void push_raw_quad(mu_Rect dst, float uv[8], mu_Color color, GLuint tex, int rgba) {
+    dst.x += translation.x;
+    dst.y += translation.y;
     if (buf_idx == BUFFER_SIZE) flush();
+    if (!reserve_vertices(buf_idx + 1)) return;
+    if (retained) batch_quad(tex, rgba);
 
     int vi = buf_idx * 4;
     int ii = buf_idx * 6;
 
     // Vertices (counter-clockwise)
-    vertices[vi + 0] = (Vertex){{dst.x,          dst.y         }, {uv[0], uv[1]}, {color.r, color.g, color.b, color.a}};
-    vertices[vi + 1] = (Vertex){{dst.x + dst.w,  dst.y         }, {uv[2], uv[3]}, {color.r, color.g, color.b, color.a}};
-    vertices[vi + 2] = (Vertex){{dst.x + dst.w,  dst.y + dst.h }, {uv[4], uv[5]}, {color.r, color.g, color.b, color.a}};
-    vertices[vi + 3] = (Vertex){{dst.x,          dst.y + dst.h }, {uv[6], uv[7]}, {color.r, color.g, color.b, color.a}};
+    vertices[vi + 0] = (Vertex){{dst.x,          dst.y         }, {uv[0], uv[1]}, {color.r, color.g, color.b, color.a}, TEXTURED};
+    vertices[vi + 1] = (Vertex){{dst.x + dst.w,  dst.y         }, {uv[2], uv[3]}, {color.r, color.g, color.b, color.a}, TEXTURED};
+    vertices[vi + 2] = (Vertex){{dst.x + dst.w,  dst.y + dst.h }, {uv[4], uv[5]}, {color.r, color.g, color.b, color.a}, TEXTURED};
+    vertices[vi + 3] = (Vertex){{dst.x,          dst.y + dst.h }, {uv[6], uv[7]}, {color.r, color.g, color.b, color.a}, TEXTURED};
 
     // Indices (two triangles)
     GLushort base = buf_idx * 4;
@@ -276,31 +816,156 @@ static void push_raw_quad(mu_Rect dst, float uv[8], mu_Color color) {
 }
 
 
-void r_draw_text(const char *text,mu_Font font, mu_Vec2 pos, mu_Color color) {
-    if (font) {
-        flush(); // render any pending quads first
-        // Render SDL_TTF surface
-        SDL_Color sdl_color = { color.r, color.g, color.b, color.a };
-        SDL_Surface *surface = TTF_RenderUTF8_Blended(*(TTF_Font **)font, text, sdl_color);
-        if (!surface) return;
+static TextEntry *find_text(const char *text, int len, mu_Id hash, mu_Font font, mu_Color color) {
+    for (int i = 0; i < text_cache_count; i++) {
+        TextEntry *e = &text_cache[i];
+        if (e->hash == hash && e->len == len && e->font == font && !memcmp(&e->color, &color, sizeof(color)) &&
+            !memcmp(e->text, text, len)) return e;
+    }
+    return NULL;
+}
+
+// A free entry, or the least recently used one not drawn in the current frame;
+// NULL when every entry is part of the frame.
+static TextEntry *alloc_text(void) {
+    TextEntry *lru = NULL;
+    if (text_cache_count < MAX_TEXT_CACHE) return &text_cache[text_cache_count++];
+    for (int i = 0; i < text_cache_count; i++) {
+        if (text_cache[i].last_used == frame_count) continue;
+        if (!lru || text_cache[i].last_used < lru->last_used) lru = &text_cache[i];
+    }
+    if (lru) {
+        glDeleteTextures(1, &lru->texture);
+        free(lru->text);
+    }
+    return lru;
+}
 
-        // Ensure RGBA32 format
-        SDL_Surface *rgba_surface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
-        SDL_FreeSurface(surface);
-        if (!rgba_surface) return;
+static GLuint upload_text(const char *text, TTF_Font *ttf, mu_Color color, int *w, int *h) {
+    // Render SDL_TTF surface
+    SDL_Color sdl_color = { color.r, color.g, color.b, color.a };
+    SDL_LockMutex(ttf_lock);
+    SDL_Surface *surface = TTF_RenderUTF8_Blended(ttf, text, sdl_color);
+    SDL_UnlockMutex(ttf_lock);
+    if (!surface) return 0;
 
-        // Create texture for this text
-        GLuint texid;
-        glGenTextures(1, &texid);
-        glBindTexture(GL_TEXTURE_2D, texid);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-                    rgba_surface->w, rgba_surface->h,
-                    0, GL_RGBA, GL_UNSIGNED_BYTE, rgba_surface->pixels);
+    // Ensure RGBA32 format
+    SDL_Surface *rgba_surface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(surface);
+    if (!rgba_surface) return 0;
 
+    // Create texture for this text
+    GLuint texid;
+    glGenTextures(1, &texid);
+    glBindTexture(GL_TEXTURE_2D, texid);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                rgba_surface->w, rgba_surface->h,
+                0, GL_RGBA, GL_UNSIGNED_BYTE, rgba_surface->pixels);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    *w = rgba_surface->w;
+    *h = rgba_surface->h;
+    SDL_FreeSurface(rgba_surface);
+    return texid;
+}
+
+static GLuint sdf_texture(const sdf_Font *font) {
+    int i = (int)(font - sdf_fonts);
+    if (!sdf_textures[i]) {
+        glGenTextures(1, &sdf_textures[i]);
+        glBindTexture(GL_TEXTURE_2D, sdf_textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, font->atlas_w, font->atlas_h, 0,
+                     GL_ALPHA, GL_UNSIGNED_BYTE, font->atlas);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    return sdf_textures[i];
+}
+
+// Immediate mode draws what is pending with the atlas bound.
+static void flush_sdf(GLuint tex) {
+    if (retained) { flush(); return; }
+    glBindTexture(GL_TEXTURE_2D, tex);
+    textflush(0);
+}
+
+// One quad per glyph out of the shared atlas, at fractional positions so text
+// animating in size does not jitter. Nothing is rasterized or uploaded here.
+static void draw_sdf_text(const char *text, int len, const sdf_Face *face, mu_Vec2 pos, mu_Color color) {
+    const sdf_Font *font = face->font;
+    GLuint tex = sdf_texture(font);
+    float scale = face->size / font->size;
+    float pen = pos.x + translation.x, top = pos.y + translation.y;
+    short edge = sdf_threshold(face);
+    const sdf_Glyph *prev = NULL;
+    if (!retained) flush(); // pending quads use the UI atlas
+    for (const char *p = text, *end = text + len; p < end; ) {
+        const sdf_Glyph *g = sdf_glyph(font, &p, end);
+        pen += sdf_kerning(font, prev, g) * scale;
+        prev = g;
+        if (g->w) {
+            if (buf_idx == BUFFER_SIZE) flush_sdf(tex);
+            if (!reserve_vertices(buf_idx + 1)) break;
+            if (retained) batch_quad(tex, 0);
+            float x0 = pen + g->left * scale, y0 = top + g->top * scale;
+            float x1 = x0 + g->w * scale, y1 = y0 + g->h * scale;
+            float u0 = g->x / (float)font->atlas_w, v0 = g->y / (float)font->atlas_h;
+            float u1 = (g->x + g->w) / (float)font->atlas_w, v1 = (g->y + g->h) / (float)font->atlas_h;
+            Vertex v = { {x0, y0}, {u0, v0}, {color.r, color.g, color.b, color.a}, {0, 0, 0, 0}, {0, 0, edge, -2} };
+            int vi = buf_idx * 4, ii = buf_idx * 6;
+            vertices[vi + 0] = v;
+            v.pos[0] = x1; v.tex[0] = u1;
+            vertices[vi + 1] = v;
+            v.pos[1] = y1; v.tex[1] = v1;
+            vertices[vi + 2] = v;
+            v.pos[0] = x0; v.tex[0] = u0;
+            vertices[vi + 3] = v;
+
+            GLushort base = buf_idx * 4;
+            indices[ii + 0] = base + 0;
+            indices[ii + 1] = base + 1;
+            indices[ii + 2] = base + 2;
+            indices[ii + 3] = base + 0;
+            indices[ii + 4] = base + 2;
+            indices[ii + 5] = base + 3;
+            buf_idx++;
+        }
+        pen += g->advance * scale;
+    }
+    if (!retained) flush_sdf(tex);
+}
+
+// text[len] is '\0', hash identifies the len bytes of text (see mu_TextCommand).
+void r_draw_text(const char *text, int len, mu_Id hash, mu_Font font, mu_Vec2 pos, mu_Color color) {
+    sdf_Face *face = ready_face(font);
+    TTF_Font *ttf = ttf_font(font);
+    if (face) {
+        draw_sdf_text(text, len, face, pos, color);
+    } else if (ttf) {
+        if (!retained) flush(); // render any pending quads first
+        TextEntry *e = find_text(text, len, hash, font, color);
+        GLuint texid;
+        int w, h;
+        if (e) {
+            texid = e->texture;
+            w = e->w;
+            h = e->h;
+        } else {
+            char *copy;
+            texid = upload_text(text, ttf, color, &w, &h);
+            if (!texid) return;
+            if ((copy = malloc(len + 1)) && (e = alloc_text())) {
+                memcpy(copy, text, len + 1);
+                *e = (TextEntry){ hash, len, copy, font, color, texid, w, h, 0 };
+            } else {
+                free(copy);
+            }
+        }
 
         // UVs (flip vertically because SDL surfaces are top-left origin)
         float uv[8] = {
@@ -313,23 +978,31 @@ void r_draw_text(const char *text,mu_Font font, mu_Vec2 pos, mu_Color color) {
         };
 
         // Destination rectangle
-        mu_Rect dst = { pos.x, pos.y, rgba_surface->w, rgba_surface->h };
+        mu_Rect dst = { pos.x, pos.y, w, h };
 
         // Push quad into vertices[] (used by flush)
-        push_raw_quad(dst, uv, color);
+        push_raw_quad(dst, uv, color, texid, 0);
+        if (e) e->last_used = frame_count;
+
+        if (retained) {
+            // drawn with the rest of the frame, uncached textures are freed after it
+            if (e) return;
+            if (text_texture_count == MAX_TEXT_TEXTURES) { flush(); }
+            text_textures[text_texture_count++] = texid;
+            return;
+        }
 
         // Bind the texture BEFORE flush
         glBindTexture(GL_TEXTURE_2D, texid);
 
         // Flush the quad immediately
-        textflush();
+        textflush(0);
 
         // Cleanup
-        SDL_FreeSurface(rgba_surface);
-        glDeleteTextures(1, &texid);
+        if (!e) glDeleteTextures(1, &texid);
     } else {
         mu_Rect dst = {pos.x, pos.y, 0, 0};
-        for (const char *p = text; *p; p++) {
+        for (const char *p = text; p < text + len; p++) {
             if ((*p & 0xc0) == 0x80) continue;
             int chr = mu_min((unsigned char)*p, 127);
             mu_Rect src = atlas[ATLAS_FONT + chr];
@@ -349,7 +1022,11 @@ void r_draw_icon(int id, mu_Rect rect, mu_Color color) {
 }
 
 int r_get_text_width(mu_Font font,const char *text, int len) {
-    if (!font) {
+    sdf_Face *face = ready_face(font);
+    TTF_Font *ttf = ttf_font(font);
+    if (face) {
+        return (int)(sdf_text_width(face, text, len) + 0.5f);
+    } else if (!ttf) {
         int res = 0;
         for (const char *p = text; *p && len--; p++) {
             if ((*p & 0xc0) == 0x80) continue;
@@ -364,10 +1041,12 @@ int r_get_text_width(mu_Font font,const char *text, int len) {
         
         int width = 0;
         int height = 0;
-        if (TTF_SizeUTF8(*(TTF_Font**)font, chars, &width, &height) < 0) {
+        SDL_LockMutex(ttf_lock);
+        int err = TTF_SizeUTF8(ttf, chars, &width, &height);
+        SDL_UnlockMutex(ttf_lock);
+        if (err < 0) {
             free(chars);
             return 0;
-        } else {
         }
         
         free(chars);
@@ -377,17 +1056,572 @@ int r_get_text_width(mu_Font font,const char *text, int len) {
 }
 
 int r_get_text_height(mu_Font font) {
-    if (!font) return 18; // fallback
-    return TTF_FontHeight(*(TTF_Font**)font);
+    sdf_Face *face = ready_face(font);
+    TTF_Font *ttf = ttf_font(font);
+    if (face) return sdf_line_height(face);
+    if (!ttf) return 18; // built-in font
+    SDL_LockMutex(ttf_lock);
+    int h = TTF_FontHeight(ttf);
+    SDL_UnlockMutex(ttf_lock);
+    return h;
+}
+
+/* uploads the quads that differ from the resident copy, in contiguous runs */
+static void upload_changed(int quads) {
+    const int quad_bytes = 4 * sizeof(Vertex);
+    for (int i = 0; i < quads; ) {
+        int j = i;
+        while (j < quads && (j >= resident_quads || memcmp(&vertices[j * 4], &resident[j * 4], quad_bytes))) j++;
+        if (j > i) {
+            glBufferSubData(GL_ARRAY_BUFFER, i * quad_bytes, (j - i) * quad_bytes, &vertices[i * 4]);
+            memcpy(&resident[i * 4], &vertices[i * 4], (j - i) * quad_bytes);
+            i = j;
+        } else {
+            i++;
+        }
+    }
+    if (quads > resident_quads) resident_quads = quads;
+}
+
+static void retained_flush(void) {
+    if (buf_idx == 0) return;
+    glUseProgram(shader_program);
+
+    set_projection();
+
+    glBindVertexArray(vao);
+    reserve_quads(buf_idx);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    upload_changed(buf_idx);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    if (!indices_ready) {
+        for (int q = 0; q < buffer_quads; q++) {
+            GLushort base = q * 4;
+            GLushort quad[6] = { base + 0, base + 1, base + 2, base + 0, base + 2, base + 3 };
+            memcpy(&indices[q * 6], quad, sizeof(quad));
+        }
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, buffer_quads * 6 * sizeof(GLushort), indices);
+        indices_ready = 1;
+    }
+
+    for (int i = 0; i < batch_count; i++) {
+        Batch *b = &batches[i];
+        glScissor(b->clip.x, target_h - (b->clip.y + b->clip.h), b->clip.w, b->clip.h);
+        glBindTexture(GL_TEXTURE_2D, b->texture);
+        if (b->rgba) set_rgba(1);
+        glDrawElements(GL_TRIANGLES, b->count * 6, GL_UNSIGNED_SHORT, (void*)(b->first * 6 * sizeof(GLushort)));
+        draw_stats.flushes++;
+        if (b->rgba) set_rgba(0);
+    }
+    glScissor(cur_clip.x, target_h - (cur_clip.y + cur_clip.h), cur_clip.w, cur_clip.h);
+
+    glDeleteTextures(text_texture_count, text_textures);
+    text_texture_count = 0;
+    batch_count = 0;
+    buf_idx = 0;
+}
+
+// Switches between re-uploading every quad (0) and retained geometry (1).
+void r_set_retained(int on) {
+    flush();
+    retained = on;
+    resident_quads = 0;
+    indices_ready = 0;
+}
+
+static mu_Rect intersect_rects(mu_Rect a, mu_Rect b) {
+    int x1 = mu_max(a.x, b.x);
+    int y1 = mu_max(a.y, b.y);
+    int x2 = mu_min(a.x + a.w, b.x + b.w);
+    int y2 = mu_min(a.y + a.h, b.y + b.h);
+    if (x2 < x1) x2 = x1;
+    if (y2 < y1) y2 = y1;
+    return mu_rect(x1, y1, x2 - x1, y2 - y1);
+}
+
+// Sets the scissor rect in target coordinates, nothing is flushed when it is
+// already set.
+static void apply_clip(mu_Rect rect) {
+    if (!memcmp(&rect, &cur_clip, sizeof(rect)) && clip_target_h == target_h) return;
+    cur_clip = rect;
+    clip_target_h = target_h;
+    draw_stats.clips++;
+    if (retained) return;
+    flush();
+    glScissor(rect.x, target_h - (rect.y + rect.h), rect.w, rect.h);
 }
 
 void r_set_clip_rect(mu_Rect rect) {
+    rect.x += translation.x;
+    rect.y += translation.y;
+    apply_clip(intersect_rects(rect, bound));
+}
+
+static void free_layer(Layer *l) {
+    glDeleteFramebuffers(1, &l->fbo);
+    glDeleteTextures(1, &l->texture);
+    layer_bytes -= l->w * l->h * 4;
+    *l = layers[--layer_count];
+}
+
+// Frees the least recently used layer not drawn in the current frame.
+static int evict_layer(void) {
+    Layer *lru = NULL;
+    for (int i = 0; i < layer_count; i++) {
+        if (layers[i].last_used == frame_count) continue;
+        if (!lru || layers[i].last_used < lru->last_used) lru = &layers[i];
+    }
+    if (!lru) return 0;
+    free_layer(lru);
+    layer_stats.evictions++;
+    return 1;
+}
+
+// Returns a w x h target for id, NULL when it does not fit the budget.
+static Layer *alloc_layer(mu_Id id, int w, int h) {
+    Layer *l = NULL;
+    for (int i = 0; i < layer_count; i++) {
+        if (layers[i].id == id) l = &layers[i];
+    }
+    if (l && l->w == w && l->h == h) return l;
+    if (l) free_layer(l);
+    if (w * h * 4 > layer_budget) return NULL;
+    while (layer_count == MAX_LAYERS || layer_bytes + w * h * 4 > layer_budget) {
+        if (!evict_layer()) return NULL;
+    }
+    l = &layers[layer_count++];
+    l->id = id;
+    l->w = w;
+    l->h = h;
+    glGenTextures(1, &l->texture);
+    glBindTexture(GL_TEXTURE_2D, l->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glGenFramebuffers(1, &l->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, l->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, l->texture, 0);
+    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    layer_bytes += w * h * 4;
+    return l;
+}
+
+// Draws a layer's texture at rect, in the current translation, clipped to clip.
+static void composite_layer(Layer *l, mu_Rect rect, mu_Rect clip) {
+    // the texture's first row is the bottom of the layer
+    float uv[8] = { 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f };
+    mu_Rect scissor = cur_clip;
+    apply_clip(clip);
+    push_raw_quad(rect, uv, mu_color(255, 255, 255, 255), l->texture, 1);
+    if (!retained) {
+        glBindTexture(GL_TEXTURE_2D, l->texture);
+        textflush(1);
+    }
+    apply_clip(scissor);
+}
+
+// Starts a layer. Returns 1 when its cached pixels were composited, the caller
+// then skips to the layer's end command. Otherwise the following commands are
+// rendered into the layer, or straight through when it has no room or another
+// layer is being rendered, until r_end_layer.
+int r_begin_layer(mu_Id id, mu_Id version, mu_Rect rect, mu_Rect clip) {
+    LayerFrame *f;
+    Layer *l = NULL;
+    assert(layer_depth < LAYER_STACK_SIZE);
+    clip = intersect_rects(mu_rect(clip.x + translation.x, clip.y + translation.y, clip.w, clip.h), bound);
+    if (!recording && rect.w > 0 && rect.h > 0) {
+        for (int i = 0; i < layer_count; i++) {
+            if (layers[i].id == id) l = &layers[i];
+        }
+        if (l && l->version == version && l->w == rect.w && l->h == rect.h && !l->incomplete) {
+            l->last_used = frame_count;
+            layer_stats.hits++;
+            composite_layer(l, rect, clip);
+            return 1;
+        }
+        layer_stats.misses++;
+        l = alloc_layer(id, rect.w, rect.h);
+    }
+    f = &layer_stack[layer_depth++];
+    f->layer = l;
+    f->translation = translation;
+    f->scissor = cur_clip;
+    f->bound = bound;
+    f->rect = rect;
+    f->clip = clip;
+    if (!l) {
+        bound = clip;
+        apply_clip(bound);
+        return 0;
+    }
     flush();
-    glScissor(rect.x, height - (rect.y + rect.h), rect.w, rect.h);
+    l->version = version;
+    l->last_used = frame_count;
+    l->incomplete = 0;
+    recording = 1;
+    glBindFramebuffer(GL_FRAMEBUFFER, l->fbo);
+    target_w = l->w;
+    target_h = l->h;
+    glViewport(0, 0, target_w, target_h);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    set_rgba(0);
+    translation = mu_vec2(-rect.x, -rect.y);
+    bound = mu_rect(0, 0, l->w, l->h);
+    apply_clip(bound);
+    return 0;
+}
+
+// Ends the innermost layer that r_begin_layer did not skip.
+void r_end_layer(void) {
+    LayerFrame *f;
+    assert(layer_depth > 0);
+    f = &layer_stack[--layer_depth];
+    translation = f->translation;
+    bound = f->bound;
+    if (f->layer) {
+        flush();
+        recording = 0;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        target_w = width;
+        target_h = height;
+        glViewport(0, 0, width, height);
+        set_rgba(0);
+        composite_layer(f->layer, f->rect, f->clip);
+    }
+    apply_clip(f->scissor);
+}
+
+// Limits the bytes held by layer textures, evicting the least recently used.
+void r_set_layer_budget(int bytes) {
+    layer_budget = bytes;
+    while (layer_bytes > layer_budget && layer_count > 0) {
+        Layer *lru = &layers[0];
+        for (int i = 1; i < layer_count; i++) {
+            if (layers[i].last_used < lru->last_used) lru = &layers[i];
+        }
+        free_layer(lru);
+        layer_stats.evictions++;
+    }
+}
+
+r_LayerStats r_layer_stats(void) {
+    r_LayerStats s = layer_stats;
+    s.layers = layer_count;
+    s.bytes = layer_bytes;
+    return s;
+}
+
+// A handle for the image file at path, decoded when first drawn. See
+// img_set_decoder for formats other than BMP.
+mu_Image r_load_image(const char *path) {
+    return img_create(path);
+}
+
+static GLuint new_image_texture(int w, int h) {
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return tex;
+}
+
+// Frees the least recently drawn page or image texture that was not drawn in
+// the previous frame. Images on it are uploaded again when drawn.
+static int evict_image(void) {
+    int page = -1, own = -1, oldest = frame_count - 1;
+    for (int i = 0; i < MAX_IMAGE_PAGES; i++) {
+        if (image_pages[i].texture && image_pages[i].last_used < oldest) {
+            oldest = image_pages[i].last_used;
+            page = i;
+        }
+    }
+    for (int i = 0; i < IMG_MAX_IMAGES; i++) {
+        ImageSlot *s = &image_slots[i];
+        if (s->texture && s->page < 0 && s->last_used < oldest) {
+            oldest = s->last_used;
+            own = i;
+        }
+    }
+    if (own >= 0) {
+        ImageSlot *s = &image_slots[own];
+        glDeleteTextures(1, &s->texture);
+        image_bytes -= s->w * s->h * 4;
+        s->texture = 0;
+        s->rows = 0;
+    } else if (page >= 0) {
+        glDeleteTextures(1, &image_pages[page].texture);
+        image_pages[page].texture = 0;
+        image_bytes -= IMAGE_PAGE_SIZE * IMAGE_PAGE_SIZE * 4;
+        for (int i = 0; i < IMG_MAX_IMAGES; i++) {
+            if (image_slots[i].texture && image_slots[i].page == page) {
+                image_slots[i].texture = 0;
+                image_slots[i].rows = 0;
+            }
+        }
+    } else {
+        return 0;
+    }
+    image_stats.evictions++;
+    return 1;
+}
+
+// Makes room for bytes more within the budget; a single image larger than
+// the budget is still let in when nothing else is held.
+static int reserve_image_bytes(int bytes) {
+    while (image_bytes + bytes > image_budget) {
+        if (!evict_image()) return image_bytes == 0;
+    }
+    return 1;
+}
+
+// Takes w x h on the page at its pen, 0 when that does not fit.
+static int page_take(ImagePage *p, int w, int h, int *x, int *y) {
+    int px = p->pen_x, py = p->pen_y, row_h = p->row_h;
+    if (px + w > IMAGE_PAGE_SIZE) {
+        px = 0;
+        py += row_h;
+        row_h = 0;
+    }
+    if (py + h > IMAGE_PAGE_SIZE) return 0;
+    *x = px;
+    *y = py;
+    p->pen_x = px + w;
+    p->pen_y = py;
+    p->row_h = mu_max(row_h, h);
+    return 1;
+}
+
+// Gives the slot a texture region, 0 when the budget has no room left for it.
+static int place_image(ImageSlot *s, int w, int h) {
+    s->w = w;
+    s->h = h;
+    s->rows = 0;
+    if (w > IMAGE_PAGE_SIZE / 4 || h > IMAGE_PAGE_SIZE / 4) {
+        if (!reserve_image_bytes(w * h * 4)) return 0;
+        s->texture = new_image_texture(w, h);
+        s->page = -1;
+        s->x = s->y = 0;
+        image_bytes += w * h * 4;
+        return 1;
+    }
+    for (int i = 0; i < MAX_IMAGE_PAGES; i++) {
+        ImagePage *p = &image_pages[i];
+        if (p->texture && page_take(p, w, h, &s->x, &s->y)) {
+            p->last_used = frame_count; // not evicted for the next image placed
+            s->texture = p->texture;
+            s->page = i;
+            return 1;
+        }
+    }
+    if (!reserve_image_bytes(IMAGE_PAGE_SIZE * IMAGE_PAGE_SIZE * 4)) return 0;
+    for (int i = 0; i < MAX_IMAGE_PAGES; i++) {
+        ImagePage *p = &image_pages[i];
+        if (p->texture) continue;
+        *p = (ImagePage){ new_image_texture(IMAGE_PAGE_SIZE, IMAGE_PAGE_SIZE), 0, 0, 0, frame_count };
+        image_bytes += IMAGE_PAGE_SIZE * IMAGE_PAGE_SIZE * 4;
+        page_take(p, w, h, &s->x, &s->y);
+        s->texture = p->texture;
+        s->page = i;
+        return 1;
+    }
+    return 0;
+}
+
+// The buffer ring needs GLES 3 entry points, without them rows are uploaded
+// from client memory.
+static void init_uploads(void) {
+    map_buffer_range = (PFNGLMAPBUFFERRANGEEXTPROC)SDL_GL_GetProcAddress("glMapBufferRange");
+    unmap_buffer = (PFNGLUNMAPBUFFEROESPROC)SDL_GL_GetProcAddress("glUnmapBuffer");
+    fence_sync = (PFNGLFENCESYNCAPPLEPROC)SDL_GL_GetProcAddress("glFenceSync");
+    client_wait_sync = (PFNGLCLIENTWAITSYNCAPPLEPROC)SDL_GL_GetProcAddress("glClientWaitSync");
+    delete_sync = (PFNGLDELETESYNCAPPLEPROC)SDL_GL_GetProcAddress("glDeleteSync");
+    if (!map_buffer_range || !unmap_buffer || !fence_sync || !client_wait_sync || !delete_sync) {
+        uploads_ready = -1;
+        return;
+    }
+    for (int i = 0; i < UPLOAD_SLOTS; i++) {
+        glGenBuffers(1, &upload_slots[i].pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, upload_slots[i].pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER_NV, UPLOAD_SLOT_BYTES, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, 0);
+    uploads_ready = 1;
+}
+
+typedef struct {
+    ImageSlot *slot;
+    img_Image *image;
+    const unsigned char *pixels;
+    int rows, offset; // taken from the buffer at offset
+} UploadBand;
+
+// Copies the next rows of placed images into one buffer of the ring and
+// uploads them from there. 0 when the GPU still reads that buffer or nothing
+// is left to upload.
+static int upload_bands(void) {
+    UploadBand bands[MAX_UPLOAD_BANDS];
+    int count = 0, offset = 0;
+    UploadSlot *u = &upload_slots[upload_next];
+    if (u->fence) {
+        if (client_wait_sync(u->fence, 0, 0) == GL_TIMEOUT_EXPIRED_APPLE) return 0;
+        delete_sync(u->fence);
+        u->fence = 0;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, u->pbo);
+    unsigned char *dst = map_buffer_range(GL_PIXEL_UNPACK_BUFFER_NV, 0, UPLOAD_SLOT_BYTES, GL_MAP_WRITE_BIT_EXT | GL_MAP_INVALIDATE_BUFFER_BIT_EXT);
+    if (!dst) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, 0);
+        return 0;
+    }
+    for (int i = 0; i < image_queue_count && count < MAX_UPLOAD_BANDS; i++) {
+        ImageSlot *s = &image_slots[img_index(image_queue[i])];
+        int w, h, pitch = s->w * 4;
+        const unsigned char *pixels = img_pixels(image_queue[i], &w, &h);
+        if (!pixels || !s->texture || s->rows == s->h) continue;
+        int rows = mu_min(s->h - s->rows, (UPLOAD_SLOT_BYTES - offset) / pitch);
+        if (rows == 0) break;
+        memcpy(dst + offset, pixels + (size_t)s->rows * pitch, (size_t)rows * pitch);
+        bands[count++] = (UploadBand){ s, image_queue[i], pixels, rows, offset };
+        offset += rows * pitch;
+    }
+    unmap_buffer(GL_PIXEL_UNPACK_BUFFER_NV);
+    for (int i = 0; i < count; i++) {
+        ImageSlot *s = bands[i].slot;
+        glBindTexture(GL_TEXTURE_2D, s->texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, s->x, s->y + s->rows, s->w, bands[i].rows,
+                        GL_RGBA, GL_UNSIGNED_BYTE, (const void *)(intptr_t)bands[i].offset);
+        s->rows += bands[i].rows;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, 0);
+    if (count == 0) return 0;
+    u->fence = fence_sync(GL_SYNC_GPU_COMMANDS_COMPLETE_APPLE, 0);
+    upload_next = (upload_next + 1) % UPLOAD_SLOTS;
+    return 1;
+}
+
+// Without the ring: the same bytes a frame, straight from the decoded pixels.
+static void upload_direct(void) {
+    int left = UPLOAD_SLOTS * UPLOAD_SLOT_BYTES;
+    for (int i = 0; i < image_queue_count && left > 0; i++) {
+        ImageSlot *s = &image_slots[img_index(image_queue[i])];
+        int w, h, pitch = s->w * 4;
+        const unsigned char *pixels = img_pixels(image_queue[i], &w, &h);
+        if (!pixels || !s->texture || s->rows == s->h) continue;
+        int rows = mu_max(mu_min(s->h - s->rows, left / pitch), 1);
+        glBindTexture(GL_TEXTURE_2D, s->texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, s->x, s->y + s->rows, s->w, rows,
+                        GL_RGBA, GL_UNSIGNED_BYTE, pixels + (size_t)s->rows * pitch);
+        s->rows += rows;
+        left -= rows * pitch;
+    }
+}
+
+// Once a frame, before anything is drawn: places decoded images, uploads
+// what the buffers take, and retires images that are done, failed, or went
+// out of view before they were placed.
+static void stream_images(void) {
+    if (image_queue_count == 0) return;
+    for (int i = 0; i < image_queue_count; i++) {
+        ImageSlot *s = &image_slots[img_index(image_queue[i])];
+        int w, h;
+        if (!s->texture && img_pixels(image_queue[i], &w, &h)) place_image(s, w, h);
+    }
+    if (!uploads_ready) init_uploads();
+    if (uploads_ready > 0) {
+        for (int i = 0; i < UPLOAD_SLOTS && upload_bands(); i++) {}
+    } else {
+        upload_direct();
+    }
+    for (int i = 0; i < image_queue_count; ) {
+        img_Image *image = image_queue[i];
+        ImageSlot *s = &image_slots[img_index(image)];
+        int state = img_state(image);
+        int done = s->texture && s->rows == s->h;
+        int stale = !s->texture && s->last_used < frame_count - 1 && state != IMG_DECODING;
+        if (done) image_stats.uploads++;
+        if (done || stale || state == IMG_FAILED) {
+            img_release(image);
+            s->queued = 0;
+            image_queue[i] = image_queue[--image_queue_count];
+            continue;
+        }
+        i++;
+    }
+}
+
+// Draws the image stretched over rect, faded by color.a. An image that is not
+// uploaded yet is requested and left out; a layer it is drawn into is not
+// reused, so the image shows up there as well.
+void r_draw_image(mu_Image image, mu_Rect rect, mu_Color color) {
+    img_Image *img = image;
+    if (!img) return;
+    ImageSlot *s = &image_slots[img_index(img)];
+    s->last_used = frame_count;
+    if (!s->texture || s->rows < s->h) {
+        if (!s->queued && img_state(img) != IMG_FAILED) {
+            img_hold(img); // until uploaded, see stream_images
+            s->queued = 1;
+            image_queue[image_queue_count++] = img;
+        }
+        img_request(img);
+        for (int i = layer_depth - 1; recording && i >= 0; i--) {
+            if (layer_stack[i].layer) {
+                layer_stack[i].layer->incomplete = 1;
+                break;
+            }
+        }
+        return;
+    }
+    float size_w = s->page < 0 ? s->w : IMAGE_PAGE_SIZE;
+    float size_h = s->page < 0 ? s->h : IMAGE_PAGE_SIZE;
+    if (s->page >= 0) image_pages[s->page].last_used = frame_count;
+    // half a texel in from the edges, neighbours on the page never blend in
+    float u0 = (s->x + 0.5f) / size_w, v0 = (s->y + 0.5f) / size_h;
+    float u1 = (s->x + s->w - 0.5f) / size_w, v1 = (s->y + s->h - 0.5f) / size_h;
+    float uv[8] = { u0, v0, u1, v0, u1, v1, u0, v1 };
+    if (!retained) flush();
+    push_raw_quad(rect, uv, mu_color(255, 255, 255, color.a), s->texture, 1);
+    if (!retained) {
+        glBindTexture(GL_TEXTURE_2D, s->texture);
+        textflush(1);
+    }
+}
+
+// Limits the bytes held by image textures, evicting the least recently drawn.
+void r_set_image_budget(int bytes) {
+    image_budget = bytes;
+    while (image_bytes > image_budget && evict_image()) {}
+}
+
+r_ImageStats r_image_stats(void) {
+    r_ImageStats s = image_stats;
+    s.decoding = img_decoding();
+    s.queued = image_queue_count;
+    s.bytes = image_bytes;
+    return s;
+}
+
+// Moves everything drawn afterwards, including clip rects, by delta.
+void r_translate(mu_Vec2 delta) {
+    translation.x += delta.x;
+    translation.y += delta.y;
 }
 
 void r_clear(mu_Color clr) {
     flush();
+    stream_images();
+    translation = mu_vec2(0, 0);
+    bound = mu_rect(0, 0, width, height);
+    layer_depth = 0;
     glViewport(0, 0, width, height);
     glClearColor(clr.r / 255.0f, clr.g / 255.0f, clr.b / 255.0f, clr.a / 255.0f);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -396,4 +1630,16 @@ void r_clear(mu_Color clr) {
 void r_present(void) {
     flush();
     SDL_GL_SwapWindow(window);
+    if (!first_present) first_present = SDL_GetPerformanceCounter();
+    frame_count++;
+    draw_stats.frames++;
+}
+
+// Performance counter at the first r_present, 0 before it.
+unsigned long long r_first_present(void) {
+    return first_present;
+}
+
+r_DrawStats r_draw_stats(void) {
+    return draw_stats;
 }
\ No newline at end of file
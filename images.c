@@ -0,0 +1,160 @@
+#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <string.h>
+#include "images.h"
+#include "loader.h"
+
+/* Image handles and their decoding. An image starts without pixels. Whoever
+ * needs them, a renderer uploading a texture or yuvblend scaling a copy,
+ * holds the image with img_hold and calls img_request while it has nothing
+ * to draw it from; a loader thread decodes the file. Each holder takes what
+ * it needs and calls img_release, the pixels are freed once nobody holds
+ * them, so one decode serves every holder. The next img_request after that
+ * decodes again. Decoded pixels are premultiplied. */
+
+struct img_Image {
+  char path[IMG_MAX_PATH];
+  SDL_atomic_t state;
+  int w, h; // valid once decoded, kept when the pixels are freed
+  unsigned char *pixels;
+  int holders; // under hold_lock
+};
+
+static img_Image images[IMG_MAX_IMAGES];
+static int image_count;
+static SDL_atomic_t decoding; // queued or running decode tasks
+static SDL_SpinLock hold_lock; // holders, and freeing the pixels they keep
+
+/* SDL reads BMP without further libraries, other formats need img_set_decoder */
+static unsigned char *decode_bmp(const char *path, int *w, int *h) {
+  SDL_Surface *loaded = SDL_LoadBMP(path);
+  SDL_Surface *rgba;
+  unsigned char *pixels;
+  if (!loaded) { return NULL; }
+  rgba = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+  SDL_FreeSurface(loaded);
+  if (!rgba) { return NULL; }
+  pixels = malloc((size_t)rgba->w * rgba->h * 4);
+  if (pixels) {
+    for (int y = 0; y < rgba->h; y++) {
+      memcpy(pixels + (size_t)y * rgba->w * 4, (unsigned char*)rgba->pixels + (size_t)y * rgba->pitch, rgba->w * 4);
+    }
+    *w = rgba->w;
+    *h = rgba->h;
+  }
+  SDL_FreeSurface(rgba);
+  return pixels;
+}
+
+static img_Decoder decoder = decode_bmp;
+
+static void premultiply(unsigned char *p, int count) {
+  for (int i = 0; i < count; i++, p += 4) {
+    p[0] = (p[0] * p[3] + 127) / 255;
+    p[1] = (p[1] * p[3] + 127) / 255;
+    p[2] = (p[2] * p[3] + 127) / 255;
+  }
+}
+
+static void decode_task(void *data) {
+  img_Image *image = data;
+  int w = 0, h = 0;
+  unsigned char *pixels = decoder(image->path, &w, &h);
+  if (pixels && w > 0 && h > 0) {
+    premultiply(pixels, w * h);
+    SDL_AtomicLock(&hold_lock);
+    image->w = w;
+    image->h = h;
+    if (image->holders > 0) {
+      image->pixels = pixels;
+      SDL_MemoryBarrierRelease(); /* the fields above before the state */
+      SDL_AtomicSet(&image->state, IMG_DECODED);
+    } else {
+      free(pixels); /* every holder gave up while it decoded */
+      SDL_AtomicSet(&image->state, IMG_IDLE);
+    }
+    SDL_AtomicUnlock(&hold_lock);
+  } else {
+    free(pixels);
+    SDL_Log("Failed to decode image %s", image->path);
+    SDL_AtomicSet(&image->state, IMG_FAILED);
+  }
+  SDL_AtomicAdd(&decoding, -1);
+}
+
+void img_set_decoder(img_Decoder decode) {
+  decoder = decode ? decode : decode_bmp;
+}
+
+/* a handle for the file at path, nothing is read yet; NULL when all
+ * IMG_MAX_IMAGES are taken */
+img_Image *img_create(const char *path) {
+  img_Image *image;
+  if (image_count == IMG_MAX_IMAGES) { return NULL; }
+  image = &images[image_count++];
+  SDL_strlcpy(image->path, path, sizeof(image->path));
+  SDL_AtomicSet(&image->state, IMG_IDLE);
+  return image;
+}
+
+int img_index(const img_Image *image) {
+  return (int)(image - images);
+}
+
+/* queues the decode of an IMG_IDLE image and returns the state after that.
+ * With IMG_MAX_DECODING queued already, or the loader queue full, the image
+ * stays idle and a later request queues it. Without loader threads it is
+ * decoded here. The caller holds the image, see img_hold. */
+int img_request(img_Image *image) {
+  int state = SDL_AtomicGet(&image->state);
+  if (state == IMG_IDLE && SDL_AtomicGet(&decoding) < IMG_MAX_DECODING) {
+    SDL_AtomicSet(&image->state, IMG_DECODING);
+    SDL_AtomicIncRef(&decoding);
+    if (!ld_try_submit(decode_task, image)) {
+      /* nothing pending means no threads, a full queue has LD_MAX_TASKS */
+      if (ld_pending() == 0) {
+        decode_task(image);
+      } else {
+        SDL_AtomicSet(&image->state, IMG_IDLE);
+        SDL_AtomicAdd(&decoding, -1);
+      }
+    }
+  }
+  return SDL_AtomicGet(&image->state);
+}
+
+int img_state(const img_Image *image) {
+  return SDL_AtomicGet((SDL_atomic_t*)&image->state);
+}
+
+/* the decoded pixels, NULL while there are none */
+const unsigned char *img_pixels(const img_Image *image, int *w, int *h) {
+  if (SDL_AtomicGet((SDL_atomic_t*)&image->state) != IMG_DECODED) { return NULL; }
+  SDL_MemoryBarrierAcquire();
+  *w = image->w;
+  *h = image->h;
+  return image->pixels;
+}
+
+/* keeps the pixels, once decoded, until the matching img_release */
+void img_hold(img_Image *image) {
+  SDL_AtomicLock(&hold_lock);
+  image->holders++;
+  SDL_AtomicUnlock(&hold_lock);
+}
+
+/* the caller is done with the pixels; the last holder frees them */
+void img_release(img_Image *image) {
+  SDL_AtomicLock(&hold_lock);
+  if (--image->holders == 0 && SDL_AtomicGet(&image->state) == IMG_DECODED) {
+    free(image->pixels);
+    image->pixels = NULL;
+    SDL_AtomicSet(&image->state, IMG_IDLE);
+  }
+  SDL_AtomicUnlock(&hold_lock);
+}
+
+/* decodes queued or running */
+int img_decoding(void) {
+  return SDL_AtomicGet(&decoding);
+}
@@ -0,0 +1,37 @@
+#ifndef IMAGES_H
+#define IMAGES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define IMG_MAX_IMAGES 1024
+#define IMG_MAX_PATH 256
+#define IMG_MAX_DECODING 16 // decodes queued at once, the rest of the loader queue stays free for fonts
+
+/* decodes path into w * h RGBA pixels, top row first, allocated with malloc;
+ * NULL when it cannot. Runs on loader threads. */
+typedef unsigned char *(*img_Decoder)(const char *path, int *w, int *h);
+
+enum { IMG_IDLE, IMG_DECODING, IMG_DECODED, IMG_FAILED };
+
+typedef struct img_Image img_Image;
+
+void img_set_decoder(img_Decoder decode);
+img_Image *img_create(const char *path);
+int img_index(const img_Image *image);
+int img_request(img_Image *image);
+int img_state(const img_Image *image);
+const unsigned char *img_pixels(const img_Image *image, int *w, int *h);
+void img_hold(img_Image *image);
+void img_release(img_Image *image);
+int img_decoding(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define LD_MAX_TASKS 64
+#define LD_MAX_THREADS 8
+
+typedef void (*ld_Task)(void *data);
+
+void ld_init(int threads);
+void ld_shutdown(void);
+void ld_submit(ld_Task task, void *data);
+int ld_try_submit(ld_Task task, void *data);
+int ld_pending(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -34,11 +34,13 @@ void snaptoclosestchild(mu_Context *ctx, mu_Elem* elem) {
   mu_StyleOverride anim;
   if (elem->direction==DIR_X){
     int mov=100000;
+    mu_Rect r = mu_screen_rect(elem);
     for (int i = 0; i < elem->tree.count; i++)
     {
-      int pos=ctx->element_stack.items[elem->tree.children[i]].rect.x-elem->rect.x;
-      pos+=ctx->element_stack.items[elem->tree.children[i]].rect.w/2;
-      pos-=elem->rect.w/2;
+      mu_Rect c = mu_screen_rect(&ctx->element_stack.items[elem->tree.children[i]]);
+      int pos=c.x-r.x;
+      pos+=c.w/2;
+      pos-=r.w/2;
       mov= (abs(mov) < abs(pos) ? (mov) : (pos));
     }
     anim.set_flags=MU_STYLE_SCROLL_X;
@@ -46,12 +48,13 @@ void snaptoclosestchild(mu_Context *ctx, mu_Elem* elem) {
     mu_animation_add(ctx,0,1000,anim,elem->hash);
   } else {
     int mov=100000;
+    mu_Rect r = mu_screen_rect(elem);
     for (int i = 0; i < elem->tree.count; i++)
     {
-      mu_Elem* child= &ctx->element_stack.items[elem->tree.children[i]];
+      mu_Rect c = mu_screen_rect(&ctx->element_stack.items[elem->tree.children[i]]);
       
-      int pos = (child->rect.y + child->rect.h / 2)
-                - (elem->rect.y + elem->rect.h / 2);
+      int pos = (c.y + c.h / 2)
+                - (r.y + r.h / 2);
       // printf("pos %d\n", pos);
       mov= (abs(pos) < abs(mov) ? (pos) : (mov));
     }
@@ -63,6 +66,25 @@ void snaptoclosestchild(mu_Context *ctx, mu_Elem* elem) {
   }
 }
 
+/* snaptoclosestchild for a virtual list: the item nearest to the viewport
+ * center is found by binary search instead of scanning the children */
+void snaptoclosestitem(mu_Context *ctx, mu_Elem* elem) {
+  mu_List *list = (mu_List*)elem->data;
+  mu_StyleOverride anim;
+  if (!list || list->count == 0) { return; }
+  int center = elem->rect.h / 2 - elem->style.padding - elem->anim_override->scroll.y;
+  int i = mu_list_index_at(list, center);
+  int mid = (mu_list_offset(list, i) + mu_list_offset(list, i + 1)) / 2;
+  int n = mid > center ? i - 1 : i + 1; /* the neighbour on the other side of the center */
+  if (n >= 0 && n < list->count) {
+    int nmid = (mu_list_offset(list, n) + mu_list_offset(list, n + 1)) / 2;
+    if (abs(nmid - center) < abs(mid - center)) { mid = nmid; }
+  }
+  anim.set_flags=MU_STYLE_SCROLL_Y;
+  anim.scroll.y=elem->anim_override->scroll.y-(mid-center);
+  mu_animation_add(ctx,0,300,anim,elem->hash);
+}
+
 void drag(mu_Context *ctx, mu_Elem* elem) {
       mu_StyleOverride anim;
       int mov=0;
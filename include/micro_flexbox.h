@@ -19,6 +19,10 @@ extern "C" {
 #define MU_VERSION "2.02"
 
 #define MU_COMMANDLIST_SIZE     (256 * 1024)
+#define MU_COMMAND_ALIGN        8   /* every command starts at a multiple of this */
+#define MU_SEGCACHE_SIZE        (64 * 1024) /* tail of each command list, keeps the commands of clean subtrees */
+#define MU_SEGCACHE_LISTS       2   /* command lists with a cache, e.g. both lists of a pipelined renderer */
+#define MU_SEGCACHE_MIN         4   /* subtrees with fewer elements are drawn every frame */
 #define MU_ROOTLIST_SIZE        32
 #define MU_CONTAINERSTACK_SIZE  32
 #define MU_CLIPSTACK_SIZE       32
@@ -28,13 +32,27 @@ extern "C" {
 #define MU_ANIMSTACK_SIZE       256
 #define MU_ANIMQUEUE_SIZE       16
 #define MU_STYLESTACK_SIZE      16
+#define MU_PARALLEL_THRESHOLD   16  /* subtrees with fewer elements are processed inline */
+#define MU_DEFAULT_STEP         (1000000000LL / 60) /* ns, used when no clock is set */
+#define MU_MAX_CATCHUP_STEPS    8   /* fixed steps per frame at most, a longer stall is dropped */
 
 #define MU_CONTAINERPOOL_SIZE   128
 #define MU_ELEMENTPOOL_SIZE     256
+#define MU_STATETABLE_SIZE      1024 /* power of two, at least 3x the element stack */
+#define MU_STATE_MAXAGE         60   /* frames an id can go unseen before its state is dropped */
 
 #define MU_TREENODEPOOL_SIZE    48
 #define MU_MAX_WIDTHS           16
 #define MU_MAX_CHILDREN         16
+#define MU_HITGRID_SIZE         16  /* cells per axis of the hit-test grid */
+#define MU_HITGRID_ENTRIES      (4 * MU_ELEMENTSTACK_SIZE)
+#define MU_MEMOPOOL_SIZE        32
+#define MU_MEMOARENA_SIZE       MU_ELEMENTSTACK_SIZE /* cached elements per frame */
+#define MU_MEMOSTACK_SIZE       8
+#define MU_LAYERSTACK_SIZE      8   /* nested layers open at once in one range */
+#define MU_CLIPBATCH_SIZE       64  /* draws regrouped at once, see mu_Context.clip_batching */
+#define MU_OCCLUSION_SIZE       128 /* draws compared at once, see mu_Context.occlusion */
+#define MU_OCCLUDERS            32  /* opaque draws each of them is tested against */
 
 #define MU_REAL                 float
 #define MU_REAL_FMT             "%.3g"
@@ -60,6 +78,11 @@ enum {
   MU_COMMAND_RECT,
   MU_COMMAND_TEXT,
   MU_COMMAND_ICON,
+  MU_COMMAND_TRANSLATE,
+  MU_COMMAND_LAYER,
+  MU_COMMAND_LAYER_END,
+  MU_COMMAND_BOX,
+  MU_COMMAND_IMAGE,
   MU_COMMAND_MAX
 };
 
@@ -117,10 +140,18 @@ enum {
   MU_EL_DRAGGABLE  = (1 << 2),
   MU_EL_DEBUG      = (1 << 3),
   MU_EL_STUTTER    = (1 << 4),
-  MU_EL_ANIMATABLE = (1 << 5)
+  MU_EL_ANIMATABLE = (1 << 5),
+  MU_EL_LAYER      = (1 << 6), // the renderer may cache the subtree offscreen
+  MU_EL_STATIC_TEXT = (1 << 7) // the text outlives every command list, commands point at it
   
 };
 
+enum {
+  MU_CULL_SELF     = (1 << 0), // own outline and text are fully clipped
+  MU_CULL_TEXT     = (1 << 1), // text is fully clipped, the outline may not be
+  MU_CULL_CHILDREN = (1 << 2)  // the whole subtree below is fully clipped
+};
+
 
 enum {
   MU_STATE_INACTIVE     ,
@@ -165,6 +196,8 @@ typedef struct mu_Context mu_Context;
 typedef unsigned int mu_Id;
 typedef MU_REAL mu_Real;
 typedef void* mu_Font;
+typedef void* mu_Image; /* a handle the renderer hands out, e.g. r_load_image */
+typedef long long mu_Time; /* nanoseconds */
 
 typedef struct { int x, y; } mu_Vec2;
 typedef struct { float x, y; } mu_fVec2;
@@ -178,8 +211,53 @@ typedef struct { int type, size; } mu_BaseCommand;
 typedef struct { mu_BaseCommand base; void *dst; } mu_JumpCommand;
 typedef struct { mu_BaseCommand base; mu_Rect rect; } mu_ClipCommand;
 typedef struct { mu_BaseCommand base; mu_Rect rect; mu_Color color; } mu_RectCommand;
-typedef struct { mu_BaseCommand base; mu_Font font; mu_Vec2 pos; mu_Color color; char str[1]; } mu_TextCommand;
+/* str[len] is '\0' and str lives at least as long as the command; hash is
+ * computed from the len bytes of str, width is what ctx->text_width measured */
+typedef struct { mu_BaseCommand base; mu_Font font; const char *str; int len, width; mu_Id hash; mu_Vec2 pos; mu_Color color; } mu_TextCommand;
 typedef struct { mu_BaseCommand base; mu_Rect rect; int id; mu_Color color; } mu_IconCommand;
+typedef struct { mu_BaseCommand base; mu_Vec2 offset; } mu_TranslateCommand; // added to all following coordinates
+typedef struct { mu_BaseCommand base; mu_Rect rect; mu_Color color, border_color; short border, radius; } mu_BoxCommand; // the border is inside rect
+typedef struct { mu_BaseCommand base; mu_Image image; mu_Rect rect; mu_Color color; } mu_ImageCommand; // stretched over rect, color.a fades it
+/* the commands up to `end` (a MU_COMMAND_LAYER_END) draw one layer; a renderer
+ * holding pixels for id and version may composite those and skip to `end` */
+typedef struct { mu_BaseCommand base; mu_Id id, version; mu_Rect rect, clip; void *end; } mu_LayerCommand;
+
+/* commands grow up from the start of items, the strings of the frame's text
+ * commands grow down from `text` towards them */
+typedef struct {
+  int idx;
+  int text;
+  mu_Time align; // keeps items on a MU_COMMAND_ALIGN boundary
+  char items[MU_COMMANDLIST_SIZE];
+} mu_CommandList;
+
+/* a run of commands written by one worker, linked to the next run with a JUMP;
+ * strings referenced by its text commands are kept at its top end */
+typedef struct {
+  char *base;
+  int idx;
+  int size;
+  int text; // lowest byte used by strings, size when there are none
+  mu_Rect clip; // what the renderer clips to after the last command, in local space
+} mu_CommandSegment;
+
+/* commands of a subtree kept in the cache of one command list */
+typedef struct {
+  mu_Id version; // subtree version the commands were generated for
+  int gen; // arena generation, stale records are treated as unseen
+  int offset, size; // bytes from list->items, -1 when nothing is cached
+  int saved; // pixels the occlusion pass removed from the commands
+} mu_SegmentRef;
+
+/* bump allocator over the MU_SEGCACHE_SIZE tail of a command list */
+typedef struct {
+  mu_CommandList *list;
+  int top;
+  int gen;
+  int full; // ran out of room, reset at the next frame
+  int last_frame;
+  int clip_batching, occlusion; // the passes its segments went through
+} mu_SegmentArena;
 
 typedef union {
   int type;
@@ -189,6 +267,10 @@ typedef union {
   mu_RectCommand rect;
   mu_TextCommand text;
   mu_IconCommand icon;
+  mu_TranslateCommand translate;
+  mu_LayerCommand layer;
+  mu_BoxCommand box;
+  mu_ImageCommand image;
 } mu_Command;
 
 
@@ -208,6 +290,7 @@ typedef struct {
   int children[MU_MAX_CHILDREN]; // id of children
   int count;
   int parent;
+  int end; // one past the last descendant in element_stack
 } mu_Tree;
 
 typedef struct {
@@ -240,6 +323,7 @@ typedef struct {
   mu_Color focus_color;
   
   mu_Vec2 scroll;
+  signed char radius; // of the outline's corners
 
 } mu_Style;
 
@@ -260,6 +344,7 @@ typedef struct {
   mu_Color* focus_color;
   
   mu_Vec2* scroll;
+  signed char* radius;
 
 } mu_StyleCompound;
 
@@ -275,6 +360,7 @@ typedef struct {
 #define MU_STYLE_HOVER_COLOR   (1<<8)
 #define MU_STYLE_SCROLL_X      (1<<10)
 #define MU_STYLE_SCROLL_Y      (1<<11)
+#define MU_STYLE_RADIUS        (1<<12)
 
 
 
@@ -295,6 +381,7 @@ typedef struct {
   mu_Color focus_color;
   
   mu_Vec2 scroll;
+  signed char radius;
 
 } mu_StyleOverride;
 
@@ -307,19 +394,53 @@ typedef struct {
   mu_Tree tree;
   mu_Text text;
   char text_buffer[64]; // STRUNG BUFFER
-  mu_Rect clip;
+  mu_Rect clip; // screen space
+  mu_Rect draw_clip; // screen space, what the commands are clipped to; within a layer only the layer's own rect clips
+  mu_Vec2 offset; // rect is local, the screen position is rect + offset (the ancestors' scroll)
   int content_size; //TOTAL SIZE OF ALL CHILDREN ELEMENTS TOGETHER (without padding or gap)
   int idx;
   int state;
   mu_Id hash;
   signed char tier;
   int settings;
+  int cull; // MU_CULL_* flags, set before drawing
   signed char cooldown;
   mu_Style style;
-  mu_StyleOverride *anim_override;
+  mu_StyleOverride *anim_override; // points into retained
   mu_StyleCompound anim_compound;
+  struct mu_ElemState *retained; // state kept for this id across frames
+  void *data; // widget state, e.g. the mu_List behind a virtual list
+  mu_Image image; // drawn over the rect inside the border, below the text
 } mu_Elem;
 
+/* cached element records of a memoized range, see mu_begin_memo */
+typedef struct {
+  mu_Id inputs;
+  mu_Id style; // hash of the style the range was built with
+  mu_Id first; // id the first element of the range gets
+  int frame; // frame the records were written, selects the arena
+  int start, count; // records in the arena
+} mu_Memo;
+
+typedef int (*mu_ListSizeFunc)(void *data, int index);
+
+/* A virtual list: only the items around the viewport get elements. Owned by
+ * the caller and kept across frames. Item extents must be larger than 1, like
+ * any fixed size. */
+typedef struct {
+  int count;            // number of items
+  int extent;           // item extent along the list, used when size is NULL
+  mu_ListSizeFunc size; // optional per-item extent
+  void *data;           // handed to size
+  int *offsets;         // count + 1 prefix sums, caller owned, needed with size
+  int overscan;         // items materialized beyond each edge of the viewport
+  /* filled in by the list */
+  int first, last;                 // materialized items [first, last)
+  int visible_first, visible_last; // items intersecting the viewport
+  mu_Rect rect;                    // container rect of the last layout
+  int origin;                      // screen y of item 0 in the last layout
+} mu_List;
+
 
 
 typedef struct {
@@ -328,6 +449,7 @@ typedef struct {
   int (*tween)(int t);
   double progress, time;
   mu_StyleOverride initial,prev;
+  mu_Time elapsed;
 }   mu_Anim;
 
 
@@ -337,19 +459,84 @@ typedef struct {
 
 } mu_ElemOverride;
 
+/* Per-id state kept across frames, see mu_get_state. Pointers to it stay valid
+ * until mu_end, which drops ids that were not seen for MU_STATE_MAXAGE frames. */
+typedef struct mu_ElemState {
+  mu_Id id; // 0 marks a free slot
+  int last_frame;
+  int state;
+  signed char cooldown;
+  mu_Rect rect; // rect of the last layout
+  mu_StyleOverride anim_override; // animated style, holds the scroll offset
+  int anim; // index into anim_stack, -1 when not animating
+  /* what the last layout looked like, compared to produce the frame diff */
+  int laid_out; // frame of the last layout that contained the id
+  mu_Id parent;
+  mu_Id style_hash;
+  mu_Id text_hash;
+  mu_SegmentRef seg[MU_SEGCACHE_LISTS]; // cached commands per mu_Context.seg_arenas slot
+} mu_ElemState;
+
+enum {
+  MU_DIFF_ADDED    = (1 << 0),
+  MU_DIFF_REMOVED  = (1 << 1),
+  MU_DIFF_MOVED    = (1 << 2), // new position or new parent
+  MU_DIFF_RESIZED  = (1 << 3),
+  MU_DIFF_RESTYLED = (1 << 4),
+  MU_DIFF_RETEXTED = (1 << 5)
+};
+
+/* one changed element between the last two layouts, see mu_next_diff */
+typedef struct {
+  mu_Id id;
+  int idx; // index in element_stack, -1 for removed elements
+  int flags; // MU_DIFF_*
+  mu_Rect rect, prev_rect; // layout rects, without the scroll of ancestors
+} mu_Diff;
+
 
 typedef void (*mu_anim_func)(mu_Context *ctx, mu_Elem *elem);
+typedef void (*mu_TaskFunc)(void *data, int index);
 
 typedef struct {
   mu_anim_func func;
   mu_Elem* elem;
 } mu_AnimQueueElem;
 
+/* pointer state seen by a control update */
+typedef struct {
+  mu_Vec2 mouse_pos, finger_pos;
+  int mouse_down, mouse_pressed;
+  int finger_down, finger_pressed;
+  mu_Id focus, hover;
+} mu_PointerState;
+
+/* uniform grid over the clipped rects of interactive elements, rebuilt after
+ * layout; cell c lists the elements items[start[c]] .. items[start[c + 1] - 1] */
+typedef struct {
+  mu_Rect bounds;
+  int cell_w, cell_h;
+  int start[MU_HITGRID_SIZE * MU_HITGRID_SIZE + 1];
+  short items[MU_HITGRID_ENTRIES];
+  /* the last update, to skip frames that would reproduce it */
+  mu_Id signature;
+  mu_PointerState input;
+  int settled;
+} mu_HitGrid;
+
 
 struct mu_Context {
   /* callbacks */
   int (*text_width)(mu_Font font, const char *str, int len);
   int (*text_height)(mu_Font font);
+  mu_Time (*clock)(void); /* monotonic time in nanoseconds */
+  /* runs task(data, i) for every i in [0, count) and returns once all are done */
+  void (*parallel_for)(mu_TaskFunc task, void *data, int count);
+  int parallel_threshold;
+  int clip_batching; /* regroup draws that do not overlap so those under one clip are adjacent */
+  int occlusion; /* drop draws hidden by later opaque rects and boxes */
+  int occluded_pixels; /* what that saved in the last frame */
+  int font_generation; /* set by the host, changes whenever text starts to measure differently */
   /* core state */
 
 
@@ -360,19 +547,24 @@ struct mu_Context {
   mu_Id hover;
   mu_Id focus;
   mu_Id last_id;
+  mu_Id next_key; // key of the next element, see mu_key
+  int has_next_key;
   mu_Rect last_rect;
   int last_zindex;
   int updated_focus;
   int frame;
   int tier;
-  int last_time;
-  int dt; // DELTA TIME
+  mu_Time last_time;
+  mu_Time dt; // DELTA TIME (ns)
+  mu_Time fixed_step; // 0 = variable timestep, otherwise animations advance in steps of this size
+  mu_Time time_accum;
 
   char number_edit_buf[MU_MAX_FMT];
   mu_Id number_edit;
   
   /* stacks */
-  mu_stack(char, MU_COMMANDLIST_SIZE) command_list;
+  mu_CommandList _command_list;
+  mu_CommandList *command_list; // list the frame is built into, swap it to hand frames to another thread
   mu_stack(mu_Rect, MU_CLIPSTACK_SIZE) clip_stack;
   mu_stack(mu_Id, MU_IDSTACK_SIZE) id_stack;
   mu_stack(mu_Elem, MU_ELEMENTSTACK_SIZE) element_stack;
@@ -383,8 +575,18 @@ struct mu_Context {
 
   /* retained state pools */
 
-  mu_PoolItem override_pool[MU_ELEMENTPOOL_SIZE];
-  mu_StyleOverride overrides[MU_ELEMENTPOOL_SIZE];
+  mu_ElemState state_table[MU_STATETABLE_SIZE]; // open addressing, linear probing
+  int state_count;
+  mu_HitGrid hit_grid;
+  mu_stack(mu_Id, MU_ELEMENTSTACK_SIZE) prev_ids; // pre-order ids of the last layout
+  mu_stack(mu_Diff, MU_ELEMENTSTACK_SIZE * 2) diff;
+  int last_layout_frame;
+  mu_PoolItem memo_pool[MU_MEMOPOOL_SIZE];
+  mu_Memo memos[MU_MEMOPOOL_SIZE];
+  mu_Elem memo_arena[2][MU_MEMOARENA_SIZE]; // written on even / odd frames
+  int memo_used;
+  mu_stack(int, MU_MEMOSTACK_SIZE) memo_stack; // memos being recorded
+  mu_SegmentArena seg_arenas[MU_SEGCACHE_LISTS];
 
   
   /* input state */
@@ -412,6 +614,7 @@ struct mu_Context {
 
 mu_Vec2 mu_vec2(int x, int y);
 mu_Rect mu_rect(int x, int y, int w, int h);
+mu_Rect mu_screen_rect(mu_Elem *elem);
 mu_Color mu_color(int r, int g, int b, int a);
 
 void mu_init(mu_Context *ctx);
@@ -440,13 +643,16 @@ void mu_input_text(mu_Context *ctx, const char *text);
 
 mu_Command* mu_push_command(mu_Context *ctx, int type, int size);
 int mu_next_command(mu_Context *ctx, mu_Command **cmd);
+int mu_next_command_ex(mu_CommandList *list, mu_Command **cmd);
 void mu_set_clip(mu_Context *ctx, mu_Rect rect);
 void mu_draw_rect(mu_Context *ctx, mu_Rect rect, mu_Color color);
 
 void mu_draw_outline_ex(mu_Context *ctx, mu_Rect rect, mu_Color color, int t);
+void mu_draw_box(mu_Context *ctx, mu_Rect rect, mu_Color color, mu_Color border_color, int border, int radius);
 
 void mu_draw_text(mu_Context *ctx, mu_Font font, const char *str, int len, mu_Vec2 pos, mu_Color color);
 void mu_draw_icon(mu_Context *ctx, int id, mu_Rect rect, mu_Color color);
+void mu_draw_image(mu_Context *ctx, mu_Image image, mu_Rect rect, mu_Color color);
 void mu_draw_point(mu_Context *ctx, mu_Vec2, mu_Color color);
 void mu_layout_row_ex(mu_Context *ctx, int items, const int *widths, int height,mu_Dir direction);
 void mu_layout_width(mu_Context *ctx, int width);
@@ -500,6 +706,13 @@ void mu_input_fingerup(mu_Context *ctx, int x, int y);
 
 // FLEX  FUNCTIONS
 int mu_begin_elem_ex(mu_Context *ctx, float sizex, float sizey, mu_Dir direction,int alignopts, int settings);
+void mu_key(mu_Context *ctx, mu_Id key);
+int mu_begin_memo(mu_Context *ctx, mu_Id key, mu_Id inputs_hash);
+void mu_end_memo(mu_Context *ctx);
+mu_ElemState *mu_get_state(mu_Context *ctx, mu_Id id);
+mu_ElemState *mu_find_state(mu_Context *ctx, mu_Id id);
+mu_StyleOverride* mu_get_override(mu_Context *ctx,mu_Id hash);
+int mu_next_diff(mu_Context *ctx, mu_Diff **diff);
 void mu_end_elem(mu_Context *ctx);
 void mu_resize(mu_Context *ctx);
 void mu_apply_size(mu_Context *ctx);
@@ -509,6 +722,8 @@ void mu_print_debug_tree(mu_Context *ctx);
 int mu_begin_elem_window_ex(mu_Context *ctx, const char *title, mu_Rect rect);
 void mu_end_elem_window(mu_Context *ctx);
 void mu_add_text_to_elem(mu_Context *ctx,const char* text);
+void mu_add_static_text_to_elem(mu_Context *ctx,const char* text);
+void mu_add_image_to_elem(mu_Context *ctx, mu_Image image);
 void mu_set_global_style(mu_Context *ctx,mu_Style style);
 void mu_animation_set(mu_Context *ctx,mu_anim_func anim);
 void mu_animation_add(mu_Context *ctx,int (*tween)(int* t),
@@ -523,6 +738,10 @@ void mu_adjust_style(mu_Context * ctx, mu_StyleOverride override);
 void mu_release_style(mu_Context *ctx);
 void mu_add_style(mu_Context*ctx, mu_Style style);
 void mu_pop_style(mu_Context *ctx);
+
+void mu_list_build_offsets(mu_List *list);
+int mu_list_offset(mu_List *list, int index);
+int mu_list_index_at(mu_List *list, int pos);
 #ifdef __cplusplus
 }
 #endif
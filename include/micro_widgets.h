@@ -47,17 +47,147 @@ void mu_scroller(mu_Context *ctx, const char * title, const char *entries[],int
             .padding = 5,
     });
 
-    for (int i = 0; i <size; i++)
-    {
-        mu_begin_elem_ex(ctx,1,30,DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),0);
-            mu_add_text_to_elem(ctx,entries[i]);
-        mu_end_elem(ctx);
+    /* keep the entries' records across frames while their strings stay the same */
+    int key[2] = { size, ctx->font_generation };
+    mu_Id inputs = mu_get_id(ctx,key,sizeof(key));
+    for (int i = 0; i < size; i++) {
+        mu_Id chain[2] = { inputs, mu_get_id(ctx,entries[i],(int)strlen(entries[i])) };
+        inputs = mu_get_id(ctx,chain,sizeof(chain));
+    }
+    int first = ctx->element_stack.idx;
+    if (mu_begin_memo(ctx,mu_get_id(ctx,title,strlen(title)),inputs)) {
+        for (int i = 0; i <size; i++)
+        {
+            mu_begin_elem_ex(ctx,1,30,DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),0);
+                mu_add_text_to_elem(ctx,entries[i]);
+            mu_end_elem(ctx);
+        }
+        mu_end_memo(ctx);
+    } else {
+        /* the replayed rows point at the strings of the frame that built them */
+        for (int i = 0; i < size; i++) {
+            ctx->element_stack.items[first + i].text.str = entries[i];
+        }
     }
     mu_pop_style(ctx);
     mu_end_elem(ctx);
 }
 
 
+static int list_scroll(mu_Elem *elem) {
+    return (elem->anim_override->set_flags & MU_STYLE_SCROLL_Y) ? elem->anim_override->scroll.y : elem->style.scroll.y;
+}
+
+/* queued every frame, runs after positioning and records where the items went */
+static void list_measure(mu_Context *ctx, mu_Elem *elem) {
+    mu_List *list = (mu_List*)elem->data;
+    (void)ctx;
+    list->rect = mu_screen_rect(elem);
+    list->origin = list->rect.y + elem->style.padding + list_scroll(elem);
+}
+
+static void list_spacer(mu_Context *ctx, int extent) {
+    if (extent <= 0) { return; }
+    mu_begin_elem_ex(ctx,0,(float)extent,DIR_Y,0,0);
+    ctx->current_parent->style.border_size=0;
+    mu_end_elem(ctx);
+}
+
+/* items are grouped in runs that start at multiples of MU_MAX_CHILDREN, so a
+ * range is not limited by the children one element can have, and an item
+ * keeps its group, and with it its id, while the range moves */
+static void list_group(mu_Context *ctx, mu_List *list, int index) {
+    int end = mu_min((index / MU_MAX_CHILDREN + 1) * MU_MAX_CHILDREN,list->last);
+    mu_Elem *group;
+    mu_key(ctx,index / MU_MAX_CHILDREN);
+    mu_begin_elem_ex(ctx,1,(float)(mu_list_offset(list,end) - mu_list_offset(list,index)),DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),0);
+    group = ctx->current_parent;
+    group->style.border_size=0;
+    group->style.padding=0;
+    group->style.gap=0;
+}
+
+/// @brief Begins a vertical list that only materializes its visible items.
+/// @param ctx The MicroUI context.
+/// @param list Caller-owned list state, kept across frames.
+/// @return The state of the list container, as for mu_begin_elem_ex.
+///
+/// The caller creates one element per item in [list->first, list->last), each
+/// exactly as tall as its extent and preceded by mu_list_item, then calls
+/// mu_list_end. Items before and after that range are stood in for by two
+/// spacer elements, so the work per frame depends on the viewport, not on
+/// list->count. The range is derived from the scroll offset and the viewport
+/// measured in the previous frame. Dragging and snapping work like
+/// mu_scroller. Up to (MU_MAX_CHILDREN - 3) * MU_MAX_CHILDREN items are
+/// materialized, within what MU_ELEMENTSTACK_SIZE leaves room for.
+int mu_list_begin(mu_Context *ctx, mu_List *list, float sizex, float sizey) {
+    int state = mu_begin_elem_ex(ctx,sizex,sizey,DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),MU_EL_CLICKABLE|MU_EL_STUTTER);
+    mu_Elem *elem = ctx->current_parent;
+    int cap = (MU_MAX_CHILDREN - 3) * MU_MAX_CHILDREN; /* spans MU_MAX_CHILDREN - 2 groups at most, beside both spacers */
+    int top = -list_scroll(elem);
+    int bottom = top + list->rect.h - 2 * elem->style.padding;
+
+    elem->style.gap = 0; /* item extents carry their own spacing */
+    elem->data = list;
+    /* animations attach to the last element, so queue them before the spacer */
+    switch(state){
+        case MU_STATE_UNFOCUSED:
+        case MU_STATE_JUSTHOVERED:
+            mu_animation_set(ctx,snaptoclosestitem);
+            break;
+        case MU_STATE_FOCUSED:
+            mu_animation_set(ctx,drag);
+            break;
+    }
+    mu_animation_set(ctx,list_measure);
+
+    list->visible_first = mu_list_index_at(list,top);
+    if (list->rect.h > 0) {
+        list->visible_last = mu_list_index_at(list,bottom - 1) + 1;
+    } else {
+        list->visible_last = list->visible_first + MU_MAX_CHILDREN; /* not measured yet */
+    }
+    list->visible_last = mu_min(list->visible_last,list->count);
+    list->first = mu_max(list->visible_first - list->overscan,0);
+    list->last = mu_min(list->visible_last + list->overscan,list->count);
+    if (list->last - list->first > cap) {
+        list->first = list->visible_first;
+        list->last = mu_min(list->visible_last,list->first + cap);
+    }
+    list_spacer(ctx,mu_list_offset(list,list->first));
+    return state;
+}
+
+/// @brief Starts an item of a virtual list, call it before the item's element.
+/// @param ctx The MicroUI context.
+/// @param list The virtual list.
+/// @param index The item, every one in [list->first, list->last) in order.
+///
+/// Places the item in its group and keys its element by index, so it keeps
+/// its id while the range moves.
+void mu_list_item(mu_Context *ctx, mu_List *list, int index) {
+    if (index % MU_MAX_CHILDREN == 0 && index != list->first) { mu_end_elem(ctx); }
+    if (index % MU_MAX_CHILDREN == 0 || index == list->first) { list_group(ctx,list,index); }
+    mu_key(ctx,index);
+}
+
+void mu_list_end(mu_Context *ctx, mu_List *list) {
+    if (list->last > list->first) { mu_end_elem(ctx); } /* the last group */
+    list_spacer(ctx,mu_list_offset(list,list->count) - mu_list_offset(list,list->last));
+    mu_end_elem(ctx);
+}
+
+/// @brief Returns the item under a screen position, or -1.
+/// @param list The virtual list.
+/// @param pos The screen position, e.g. ctx->mouse_pos.
+///
+/// Uses the layout of the last frame; O(log n) regardless of what is materialized.
+int mu_list_item_at(mu_List *list, mu_Vec2 pos) {
+    mu_Rect r = list->rect;
+    if (list->count == 0 || pos.x < r.x || pos.x >= r.x + r.w || pos.y < r.y || pos.y >= r.y + r.h) { return -1; }
+    if (pos.y - list->origin >= mu_list_offset(list,list->count)) { return -1; }
+    return mu_list_index_at(list,pos.y - list->origin);
+}
 
 #ifdef __cplusplus
 }
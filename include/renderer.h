@@ -8,16 +8,60 @@ extern "C" {
 
 
 #include "micro_flexbox.h"
+void r_set_program_cache(const char *path);
 void r_init(void);
 void r_draw_rect(mu_Rect rect, mu_Color color);
-void r_draw_text(const char *text,mu_Font font, mu_Vec2 pos, mu_Color color);
+void r_draw_box(mu_Rect rect, mu_Color color, mu_Color border, int border_width, int radius);
+void r_draw_text(const char *text, int len, mu_Id hash, mu_Font font, mu_Vec2 pos, mu_Color color);
 void r_draw_icon(int id, mu_Rect rect, mu_Color color);
  int r_get_text_width(mu_Font font, const char *text, int len);
  int r_get_text_height(mu_Font font);
 void r_set_clip_rect(mu_Rect rect);
+void r_translate(mu_Vec2 delta);
 void r_clear(mu_Color color);
 void r_present(void);
 void r_load_font(mu_Font *font, const char* path, unsigned char size);
+void r_load_sdf_font(mu_Font *font, const char *path, unsigned char size);
+void r_load_font_pack(mu_Font *font, const char *path, const char *name, unsigned char size);
+void r_load_font_async(mu_Font *font, const char *path, unsigned char size);
+void r_load_sdf_font_async(mu_Font *font, const char *path, unsigned char size);
+int r_font_generation(void);
+mu_Font r_font_face(mu_Font font, float size, float weight);
+void r_acquire_context(void);
+void r_release_context(void);
+void r_set_retained(int on);
+
+typedef struct {
+  int hits, misses; // layers composited from cache, and rendered again
+  int evictions; // textures freed to stay within the budget
+  int layers, bytes; // currently held
+} r_LayerStats;
+
+int r_begin_layer(mu_Id id, mu_Id version, mu_Rect rect, mu_Rect clip);
+void r_end_layer(void);
+void r_set_layer_budget(int bytes);
+r_LayerStats r_layer_stats(void);
+
+typedef struct {
+  int frames; // presented
+  int flushes; // draw calls
+  int clips; // scissor changes
+} r_DrawStats;
+
+r_DrawStats r_draw_stats(void);
+
+typedef struct {
+  int uploads; // images that became drawable
+  int evictions; // pages and textures freed to stay within the budget
+  int decoding, queued; // decodes in flight, images waiting to be drawable
+  int bytes; // held by image textures
+} r_ImageStats;
+
+mu_Image r_load_image(const char *path);
+void r_draw_image(mu_Image image, mu_Rect rect, mu_Color color);
+void r_set_image_budget(int bytes);
+r_ImageStats r_image_stats(void);
+unsigned long long r_first_present(void);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,82 @@
+#ifndef SDFFONT_H
+#define SDFFONT_H
+
+#include <SDL2/SDL_atomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define SDF_FIRST_GLYPH 32
+#define SDF_GLYPHS 95 // printable ASCII, anything else is drawn as '?'
+#define SDF_SPREAD 4 // pixels of distance stored either side of an edge, at the atlas size
+#define SDF_ATLAS_WIDTH 512
+#define SDF_MAX_FACES 32
+#define SDF_PACK_VERSION 1
+#define SDF_PACK_NAME 32
+
+/* a glyph in the atlas; offsets and advance are pixels at the atlas size */
+typedef struct {
+  short x, y, w, h; // in the atlas, spread included
+  short left, top; // of the atlas rect, from the pen at the top of the line
+  short advance;
+} sdf_Glyph;
+
+/* a kerning pair of glyph indices, amount in pixels at the atlas size */
+typedef struct {
+  unsigned char left, right;
+  short amount;
+} sdf_Kern;
+
+/* one font rasterized once into a distance-field atlas: 128 is the glyph
+ * edge, every SDF_SPREAD pixels inside or outside add or take 127 */
+typedef struct {
+  int size; // pixels the atlas was rasterized at
+  int height; // line height at size
+  int atlas_w, atlas_h;
+  unsigned char *atlas;
+  sdf_Glyph glyphs[SDF_GLYPHS];
+  const sdf_Kern *kerning; // sorted by left, then right
+  int kern_count;
+  void *mapping; // the pack the atlas and kerning point into, see sdf_map
+  long mapping_size;
+  int pen_x, pen_y, row_h; // shelf packing while glyphs are added
+  SDL_atomic_t ready; // set once the font can be drawn, see sdf_ready
+} sdf_Font;
+
+/* what a mu_Font points at for distance-field text: the atlas drawn at any
+ * size, weight > 0 thickens strokes and < 0 thins them by that many pixels
+ * at the atlas size, within SDF_SPREAD */
+typedef struct {
+  sdf_Font *font;
+  float size;
+  float weight;
+} sdf_Face;
+
+int sdf_begin(sdf_Font *font, int size, int height);
+int sdf_add_glyph(sdf_Font *font, int codepoint, const unsigned char *coverage, int w, int h, int pitch, int left, int top, int advance);
+void sdf_end(sdf_Font *font);
+int sdf_load(sdf_Font *font, const char *path, int size, const char *glyphs);
+int sdf_write_pack(const char *path, const sdf_Font *fonts, const char **names, int count);
+int sdf_map(sdf_Font *font, const char *path, const char *name);
+void sdf_free(sdf_Font *font);
+int sdf_ready(const sdf_Font *font);
+
+sdf_Face *sdf_face(sdf_Font *font, float size, float weight);
+int sdf_is_face(const void *font);
+const sdf_Glyph *sdf_glyph(const sdf_Font *font, const char **text, const char *end);
+int sdf_kerning(const sdf_Font *font, const sdf_Glyph *left, const sdf_Glyph *right);
+float sdf_text_width(const sdf_Face *face, const char *text, int len);
+int sdf_line_height(const sdf_Face *face);
+unsigned char sdf_threshold(const sdf_Face *face);
+float sdf_softness(const sdf_Face *face);
+void sdf_render(const sdf_Face *face, const char *text, int len, unsigned char *dst, int w, int h);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
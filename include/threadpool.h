@@ -0,0 +1,23 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define TP_MAX_THREADS 16
+
+typedef void (*tp_Task)(void *data, int index);
+
+void tp_init(int threads);
+void tp_shutdown(void);
+void tp_parallel_for(tp_Task task, void *data, int count);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
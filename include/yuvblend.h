@@ -0,0 +1,50 @@
+#ifndef YUVBLEND_H
+#define YUVBLEND_H
+
+#include "micro_flexbox.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define YUV_TILE 32 // pixels, a layer only blends the tiles it covers
+#define YUV_MAX_TILES_X 128 // layers up to 4096 x 2304
+#define YUV_MAX_TILES_Y 72
+#define YUV_IMAGE_BUDGET (8 << 20) // bytes of scaled image copies, see yuv_set_image_budget
+
+enum { YUV_NV12, YUV_I420 };
+enum { YUV_BT601, YUV_BT709 }; // limited range
+
+/* an 8-bit 4:2:0 frame the UI is blended into, width and height even. For
+ * YUV_NV12 u is the interleaved CbCr plane and v is unused. */
+typedef struct {
+  int format, matrix;
+  int width, height;
+  unsigned char *y, *u, *v;
+  int y_stride, uv_stride;
+} yuv_Frame;
+
+/* a premultiplied RGBA image of the UI that the caller keeps; tiles[ty][tx]
+ * is set where any of its pixels is not transparent */
+typedef struct {
+  const unsigned char *rgba;
+  int stride, w, h;
+  unsigned char tiles[YUV_MAX_TILES_Y][YUV_MAX_TILES_X];
+} yuv_Layer;
+
+void yuv_draw_commands(const yuv_Frame *frame, mu_CommandList *list);
+void yuv_set_image_budget(int bytes);
+void yuv_layer_init(yuv_Layer *layer, const unsigned char *rgba, int stride, int w, int h);
+void yuv_layer_damage(yuv_Layer *layer, mu_Rect rect);
+int yuv_layer_tiles(const yuv_Layer *layer);
+void yuv_blend_layer(const yuv_Frame *frame, const yuv_Layer *layer, int x, int y);
+const char *yuv_kernels(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
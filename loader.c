@@ -0,0 +1,94 @@
+#include <SDL2/SDL.h>
+#include "loader.h"
+
+/* Background threads that load and decode assets, so neither startup nor a
+ * frame waits on them. Tasks are started in submission order; with more than
+ * one thread they run concurrently, and a task touching a library that is not
+ * thread-safe (SDL_ttf) locks it. Tasks publish their result themselves, e.g.
+ * by storing a font into its handle atomically. Without ld_init, or once the
+ * queue is full, ld_submit runs the task on the calling thread. */
+
+static SDL_Thread *workers[LD_MAX_THREADS];
+static int thread_count;
+static SDL_mutex *lock;
+static SDL_cond *wake;
+static ld_Task tasks[LD_MAX_TASKS];
+static void *task_data[LD_MAX_TASKS];
+static int head, count; // queued tasks, ring buffer
+static int running; // taken from the queue, not finished
+static int quit;
+
+static int loader_main(void *arg) {
+  (void)arg;
+  SDL_LockMutex(lock);
+  for (;;) {
+    while (count == 0 && !quit) { SDL_CondWait(wake, lock); }
+    if (count == 0) { break; } /* quit once the queue is drained */
+    ld_Task task = tasks[head];
+    void *data = task_data[head];
+    head = (head + 1) % LD_MAX_TASKS;
+    count--;
+    running++;
+    SDL_UnlockMutex(lock);
+    task(data);
+    SDL_LockMutex(lock);
+    running--;
+  }
+  SDL_UnlockMutex(lock);
+  return 0;
+}
+
+void ld_init(int threads) {
+  if (threads > LD_MAX_THREADS) { threads = LD_MAX_THREADS; }
+  lock = SDL_CreateMutex();
+  wake = SDL_CreateCond();
+  head = count = running = quit = 0;
+  for (thread_count = 0; thread_count < threads; thread_count++) {
+    workers[thread_count] = SDL_CreateThread(loader_main, "loader", NULL);
+  }
+}
+
+/* finishes the queued tasks, then stops the threads */
+void ld_shutdown(void) {
+  if (!thread_count) { return; }
+  SDL_LockMutex(lock);
+  quit = 1;
+  SDL_CondBroadcast(wake);
+  SDL_UnlockMutex(lock);
+  for (int i = 0; i < thread_count; i++) { SDL_WaitThread(workers[i], NULL); }
+  thread_count = 0;
+  SDL_DestroyCond(wake);
+  SDL_DestroyMutex(lock);
+}
+
+/* queues the task, 0 when there are no threads or the queue is full; for
+ * work the caller would rather retry later than do itself */
+int ld_try_submit(ld_Task task, void *data) {
+  int queued = 0;
+  if (!thread_count) { return 0; }
+  SDL_LockMutex(lock);
+  if (count < LD_MAX_TASKS) {
+    int tail = (head + count) % LD_MAX_TASKS;
+    tasks[tail] = task;
+    task_data[tail] = data;
+    count++;
+    queued = 1;
+    SDL_CondSignal(wake);
+  }
+  SDL_UnlockMutex(lock);
+  return queued;
+}
+
+void ld_submit(ld_Task task, void *data) {
+  if (!ld_try_submit(task, data)) { task(data); }
+}
+
+/* tasks not finished yet */
+int ld_pending(void) {
+  int n;
+  if (!thread_count) { return 0; }
+  SDL_LockMutex(lock);
+  n = count + running;
+  SDL_UnlockMutex(lock);
+  return n;
+}
@@ -1,5 +1,8 @@
 
 #include "renderer.h"
+#include "threadpool.h"
+#include "loader.h"
+#include "yuvblend.h"
 #include "micro_flexbox.h"
 #include "micro_animations.h"
 #include "micro_widgets.h"
@@ -22,6 +25,13 @@ unsigned int rightbarwidth=100;
 
 mu_Font q_font;
 
+/* --thumbnails: a scrolling grid, only the rows in view are laid out */
+#define THUMBNAILS 500
+#define THUMBNAILS_PER_ROW 5
+static mu_Image thumbnails[THUMBNAILS];
+static int thumbnail_count;
+static mu_List thumbnail_rows;
+
 static mu_Style newstyle = {
 
   { 230, 200, 0, 255 }, /* border_color */
@@ -34,7 +44,8 @@ static mu_Style newstyle = {
   MU_ALIGN_MIDDLE|MU_ALIGN_CENTER, /* text_align*/
   { 180, 200, 0, 255 }, /* hover_color */
   { 130, 200, 230, 255 }, /* focus_color */
-  {0,0}
+  {0,0},                /* scroll */
+  0                     /* radius */
 };
 
 
@@ -60,17 +71,17 @@ static void layout(mu_Context *ctx) {
     });
     mu_begin_elem(ctx,0,30);
       mu_begin_elem_ex(ctx,-1,1,DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),0);
-        mu_add_text_to_elem(ctx,"REC");
+        mu_add_static_text_to_elem(ctx,"REC");
       mu_end_elem(ctx);
       mu_begin_elem_ex(ctx,0,0,DIR_Y,0,0);
       mu_end_elem(ctx);
       mu_begin_elem_ex(ctx,-1,1,DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),0);
-        mu_add_text_to_elem(ctx,"00:00:00");
+        mu_add_static_text_to_elem(ctx,"00:00:00");
       mu_end_elem(ctx);
       mu_begin_elem_ex(ctx,0,0,DIR_Y,0,0);
       mu_end_elem(ctx);
       mu_begin_elem_ex(ctx,-1,1,DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),0);
-        mu_add_text_to_elem(ctx,"Battery 67%");
+        mu_add_static_text_to_elem(ctx,"Battery 67%");
       mu_end_elem(ctx);
       
     mu_end_elem(ctx);
@@ -107,8 +118,23 @@ static void layout(mu_Context *ctx) {
       mu_end_elem(ctx);
 
 
-      mu_begin_elem_ex(ctx,0,0,DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),0);
-      mu_end_elem(ctx); 
+      if (thumbnail_count > 0) {
+        mu_list_begin(ctx,&thumbnail_rows,0,0);
+        for (int row = thumbnail_rows.first; row < thumbnail_rows.last; row++) {
+          mu_list_item(ctx,&thumbnail_rows,row);
+          mu_begin_elem_ex(ctx,1,(float)thumbnail_rows.extent,DIR_X,(MU_ALIGN_TOP|MU_ALIGN_LEFT),0);
+          for (int i = row * THUMBNAILS_PER_ROW; i < mu_min((row + 1) * THUMBNAILS_PER_ROW, thumbnail_count); i++) {
+            mu_begin_elem_ex(ctx,0,1,DIR_Y,0,0);
+              mu_add_image_to_elem(ctx,thumbnails[i]);
+            mu_end_elem(ctx);
+          }
+          mu_end_elem(ctx);
+        }
+        mu_list_end(ctx,&thumbnail_rows);
+      } else {
+        mu_begin_elem_ex(ctx,0,0,DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),0);
+        mu_end_elem(ctx);
+      }
 
       mu_adjust_style(ctx,
         (mu_StyleOverride){
@@ -121,15 +147,15 @@ static void layout(mu_Context *ctx) {
     mu_pop_style(ctx);
 
         mu_begin_elem_ex(ctx,1,60,DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),MU_EL_CLICKABLE|MU_EL_STUTTER);
-        mu_add_text_to_elem(ctx,"RESOLUTION");
+        mu_add_static_text_to_elem(ctx,"RESOLUTION");
         mu_end_elem(ctx); 
 
         mu_begin_elem_ex(ctx,1,60,DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),MU_EL_CLICKABLE|MU_EL_STUTTER);
-        mu_add_text_to_elem(ctx,"FRAMERATE");
+        mu_add_static_text_to_elem(ctx,"FRAMERATE");
         mu_end_elem(ctx); 
 
         mu_begin_elem_ex(ctx,1,60,DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),MU_EL_CLICKABLE|MU_EL_STUTTER);
-        mu_add_text_to_elem(ctx,"TOOLS");
+        mu_add_static_text_to_elem(ctx,"TOOLS");
         mu_end_elem(ctx); 
         mu_adjust_style(ctx,
           (mu_StyleOverride){
@@ -144,7 +170,7 @@ static void layout(mu_Context *ctx) {
         mu_end_elem(ctx); 
 
         mu_begin_elem_ex(ctx,1,60,DIR_Y,(MU_ALIGN_TOP|MU_ALIGN_LEFT),MU_EL_CLICKABLE|MU_EL_STUTTER);
-        mu_add_text_to_elem(ctx,"SETTINGS");
+        mu_add_static_text_to_elem(ctx,"SETTINGS");
         mu_end_elem(ctx); 
       mu_end_elem(ctx); 
 
@@ -191,12 +217,141 @@ static int text_height(mu_Font font) {
 
   return r_get_text_height(font);
 }
+
+/* pipelined mode: the UI thread builds frame N+1 while the render thread
+ * replays frame N. Text is copied into the command list or static, and fonts
+ * are globals, so every handle a command references outlives the handoff. */
+static mu_CommandList command_lists[2];
+static mu_CommandList *submitted_list;  // finished frame waiting for the render thread
+static SDL_sem *submitted;  // posted with submitted_list set, or to quit
+static SDL_sem *slot_free;  // posted once the render thread took submitted_list
+static SDL_sem *released;   // posted after each replay; lists are replayed in order
+static SDL_atomic_t render_quit;
+
+/* --yuv-overlay: every frame is also blended into a 1080p NV12 camera frame */
+#define YUV_WIDTH 1920
+#define YUV_HEIGHT 1080
+static yuv_Frame yuv_frame;
+static unsigned char *yuv_camera; // the frame without UI, copied in before each blend
+static Uint64 yuv_ticks;
+static int yuv_frames;
+
+static void init_yuv_overlay(void) {
+    size_t size = YUV_WIDTH * YUV_HEIGHT * 3 / 2;
+    yuv_camera = (unsigned char*) malloc(2 * size);
+    if (!yuv_camera) { return; }
+    for (int y = 0; y < YUV_HEIGHT; y++) {
+      memset(yuv_camera + y * YUV_WIDTH, 16 + y * 219 / YUV_HEIGHT, YUV_WIDTH); // a gray ramp
+    }
+    memset(yuv_camera + YUV_WIDTH * YUV_HEIGHT, 128, size - YUV_WIDTH * YUV_HEIGHT);
+    yuv_frame.format = YUV_NV12;
+    yuv_frame.matrix = YUV_BT709;
+    yuv_frame.width = YUV_WIDTH;
+    yuv_frame.height = YUV_HEIGHT;
+    yuv_frame.y = yuv_camera + size;
+    yuv_frame.u = yuv_frame.y + YUV_WIDTH * YUV_HEIGHT;
+    yuv_frame.y_stride = yuv_frame.uv_stride = YUV_WIDTH;
+}
+
+static void blend_yuv_overlay(mu_CommandList *list) {
+    memcpy(yuv_frame.y, yuv_camera, YUV_WIDTH * YUV_HEIGHT * 3 / 2);
+    Uint64 start = SDL_GetPerformanceCounter();
+    yuv_draw_commands(&yuv_frame, list);
+    yuv_ticks += SDL_GetPerformanceCounter() - start;
+    yuv_frames++;
+}
+
+static void render_commands(mu_CommandList *list) {
+    r_clear(mu_color(bg[0], bg[1], bg[2], 255));
+    mu_Command *cmd = NULL;
+    while (mu_next_command_ex(list, &cmd)) {
+      switch (cmd->type) {
+          case MU_COMMAND_TEXT: r_draw_text(cmd->text.str, cmd->text.len, cmd->text.hash, cmd->text.font, cmd->text.pos, cmd->text.color); break;
+          case MU_COMMAND_RECT: r_draw_rect(cmd->rect.rect, cmd->rect.color); break;
+          case MU_COMMAND_BOX: r_draw_box(cmd->box.rect, cmd->box.color, cmd->box.border_color, cmd->box.border, cmd->box.radius); break;
+          case MU_COMMAND_ICON: r_draw_icon(cmd->icon.id, cmd->icon.rect, cmd->icon.color); break;
+          case MU_COMMAND_IMAGE: r_draw_image(cmd->image.image, cmd->image.rect, cmd->image.color); break;
+          case MU_COMMAND_CLIP: r_set_clip_rect(cmd->clip.rect); break;
+          case MU_COMMAND_TRANSLATE: r_translate(cmd->translate.offset); break;
+          case MU_COMMAND_LAYER:
+            if (r_begin_layer(cmd->layer.id, cmd->layer.version, cmd->layer.rect, cmd->layer.clip)) { cmd = (mu_Command*) cmd->layer.end; }
+            break;
+          case MU_COMMAND_LAYER_END: r_end_layer(); break;
+      }
+    }
+    if (yuv_frame.y) { blend_yuv_overlay(list); }
+    r_present();
+}
+
+static int render_thread(void *data) {
+    (void)data;
+    r_acquire_context();
+    for (;;) {
+      SDL_SemWait(submitted); // idle without a frame, nothing spins
+      if (SDL_AtomicGet(&render_quit)) { break; }
+      mu_CommandList *list = submitted_list;
+      SDL_SemPost(slot_free);
+      render_commands(list);
+      SDL_SemPost(released);
+    }
+    r_release_context();
+    return 0;
+}
+
+/* hands the finished list to the render thread and continues on the other
+ * one once its replay is done, blocking while the render thread is behind */
+static void swap_command_lists(mu_Context *ctx) {
+    SDL_SemWait(slot_free);
+    submitted_list = ctx->command_list;
+    SDL_SemPost(submitted);
+    SDL_SemWait(released);
+    ctx->command_list = ctx->command_list == &command_lists[0] ? &command_lists[1] : &command_lists[0];
+}
+
+// taken before main, as near to process start as the program can see
+static const Uint64 process_start = SDL_GetPerformanceCounter();
+
+static mu_Time clock_ns(void) {
+  static const Uint64 freq = SDL_GetPerformanceFrequency();
+  Uint64 t = SDL_GetPerformanceCounter();
+  return (mu_Time)(t / freq) * 1000000000LL + (mu_Time)((t % freq) * 1000000000ULL / freq);
+}
 // 
 
 
 int main (int argc, char *argv[]) {
-    (void)argc; 
-    (void)argv; 
+    bool pipelined = false;
+    bool retained = false;
+    bool batch_clips = false;
+    bool occlusion = false;
+    bool sdf = false;
+    const char *font_pack = NULL;
+    const char *font_path = NULL;
+    bool async_fonts = false;
+    bool startup_bench = false;
+    int layout_bench = 0; // frames to time the layout of, then quit
+    const char *program_cache = NULL;
+    const char *thumbnail_path = NULL;
+    int threads = 1;
+    int layer_budget = -1;
+    bool yuv_overlay = false;
+    for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--pipelined") == 0) { pipelined = true; }
+      if (strcmp(argv[i], "--retained") == 0) { retained = true; }
+      if (strcmp(argv[i], "--batch-clips") == 0) { batch_clips = true; }
+      if (strcmp(argv[i], "--occlusion") == 0) { occlusion = true; }
+      if (strcmp(argv[i], "--sdf") == 0) { sdf = true; }
+      if (strcmp(argv[i], "--font-pack") == 0 && i + 1 < argc) { font_pack = argv[++i]; } // from tools/fontbake
+      if (strcmp(argv[i], "--font") == 0 && i + 1 < argc) { font_path = argv[++i]; }
+      if (strcmp(argv[i], "--async-fonts") == 0) { async_fonts = true; }
+      if (strcmp(argv[i], "--startup-bench") == 0) { startup_bench = true; } // quit after the first frame
+      if (strcmp(argv[i], "--layout-bench") == 0 && i + 1 < argc) { layout_bench = atoi(argv[++i]); } // with --threads N
+      if (strcmp(argv[i], "--program-cache") == 0 && i + 1 < argc) { program_cache = argv[++i]; }
+      if (strcmp(argv[i], "--thumbnails") == 0 && i + 1 < argc) { thumbnail_path = argv[++i]; } // a BMP shown THUMBNAILS times
+      if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) { threads = atoi(argv[++i]); }
+      if (strcmp(argv[i], "--yuv-overlay") == 0) { yuv_overlay = true; }
+      if (strcmp(argv[i], "--layer-budget") == 0 && i + 1 < argc) { layer_budget = atoi(argv[++i]) * 1024; } // KiB
+    }
 
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
       printf("SDL_Init Error: %s\n", SDL_GetError());
@@ -210,8 +365,57 @@ int main (int argc, char *argv[]) {
     }
     const char* render_driver = SDL_GetCurrentVideoDriver();
     printf("SDL Video Driver: %s\n", render_driver);
+    static char default_cache[1024];
+    if (!program_cache) {
+      char *pref = SDL_GetPrefPath("micro-flexbox", "demo");
+      if (pref) {
+        snprintf(default_cache, sizeof(default_cache), "%sprogram.bin", pref);
+        program_cache = default_cache;
+      }
+      SDL_free(pref);
+    }
+    r_set_program_cache(program_cache);
+    Uint64 init_start = SDL_GetPerformanceCounter();
     r_init();
-    r_load_font(&q_font, "/home/cinepi/micro-flexbox/assets/fonts/ZCOOL_QingKe_HuangYou/ZCOOLQingKeHuangYou-Regular.ttf", 20);
+    Uint64 init_end = SDL_GetPerformanceCounter();
+    r_set_retained(retained);
+    if (yuv_overlay) { init_yuv_overlay(); }
+    if (layer_budget >= 0) { r_set_layer_budget(layer_budget); }
+    static char default_font[1024];
+    if (!font_path) {
+      // the assets next to the executable
+      char *base = SDL_GetBasePath();
+      snprintf(default_font, sizeof(default_font), "%sassets/fonts/ZCOOL_QingKe_HuangYou/ZCOOLQingKeHuangYou-Regular.ttf", base ? base : "");
+      SDL_free(base);
+      font_path = default_font;
+    }
+    // with --async-fonts the first frames use the built-in font until the loader thread is done
+    // images are always decoded off the frame, the fonts only with --async-fonts
+    if (async_fonts || thumbnail_path) { ld_init(thumbnail_path ? 4 : 1); }
+    if (thumbnail_path) {
+      for (thumbnail_count = 0; thumbnail_count < THUMBNAILS; thumbnail_count++) {
+        thumbnails[thumbnail_count] = r_load_image(thumbnail_path);
+      }
+      thumbnail_rows.count = (THUMBNAILS + THUMBNAILS_PER_ROW - 1) / THUMBNAILS_PER_ROW;
+      thumbnail_rows.extent = 90;
+      thumbnail_rows.overscan = 1;
+    }
+    if (font_pack) {
+      // baked offline: mapped, no FreeType and no rasterization at startup
+      mu_Font pack_font;
+      r_load_font_pack(&pack_font, font_pack, NULL, 20);
+      newstyle.font = pack_font;
+    } else if (sdf) {
+      // rasterized once at 40px, every other size is drawn from the same atlas
+      mu_Font sdf_font;
+      if (async_fonts) { r_load_sdf_font_async(&sdf_font, font_path, 40); }
+      else { r_load_sdf_font(&sdf_font, font_path, 40); }
+      newstyle.font = r_font_face(sdf_font, 20, 0);
+    } else if (async_fonts) {
+      r_load_font_async(&q_font, font_path, 20);
+    } else {
+      r_load_font(&q_font, font_path, 20);
+    }
       /* init microui */
     mu_Context *ctx =(mu_Context*) malloc(sizeof(mu_Context));
     mu_init(ctx);
@@ -220,9 +424,29 @@ int main (int argc, char *argv[]) {
     // mu_set_global_style(ctx,newstyle);
     ctx->text_width = text_width;
     ctx->text_height = text_height;
+    ctx->clock = clock_ns;
+    ctx->clip_batching = batch_clips;
+    ctx->occlusion = occlusion;
+    if (threads > 1) {
+      tp_init(threads);
+      ctx->parallel_for = tp_parallel_for;
+    }
+
+    SDL_Thread *renderer = NULL;
+    if (pipelined) {
+      ctx->command_list = &command_lists[0];
+      submitted = SDL_CreateSemaphore(0);
+      slot_free = SDL_CreateSemaphore(1);
+      released = SDL_CreateSemaphore(1); // command_lists[1] starts out free
+      r_release_context();
+      renderer = SDL_CreateThread(render_thread, "render", NULL);
+    }
 
 
     bool quit = false;
+    long long occluded_pixels = 0;
+    Uint64 layout_ticks = 0, build_ticks = 0; // --layout-bench: mu_resize .. mu_adjust_elem_positions, mu_begin .. mu_end
+    int frames = 0;
     while (!quit) {
   /* main loop */
 
@@ -270,32 +494,74 @@ int main (int argc, char *argv[]) {
         /* process frame */
 
 
+        Uint64 build_start = SDL_GetPerformanceCounter();
+        ctx->font_generation = r_font_generation(); // re-measures memoized text once an async font lands
         mu_begin(ctx);
         layout(ctx);
 
+        Uint64 layout_start = SDL_GetPerformanceCounter();
         mu_resize(ctx);
         mu_apply_size(ctx);
         mu_adjust_elem_positions(ctx);
+        layout_ticks += SDL_GetPerformanceCounter() - layout_start;
         mu_animaton_runqueue(ctx);
         mu_draw_debug_elems(ctx);
         mu_animation_update(ctx);
 
         mu_end(ctx);
-
+        build_ticks += SDL_GetPerformanceCounter() - build_start;
+        occluded_pixels += ctx->occluded_pixels;
+        frames++;
 
         /* render */
-        r_clear(mu_color(bg[0], bg[1], bg[2], 255));
-        mu_Command *cmd = NULL;
-        while (mu_next_command(ctx, &cmd)) {
-          switch (cmd->type) {
-              case MU_COMMAND_TEXT: r_draw_text(cmd->text.str,cmd->text.font, cmd->text.pos, cmd->text.color); break;
-              case MU_COMMAND_RECT: r_draw_rect(cmd->rect.rect, cmd->rect.color); break;
-              case MU_COMMAND_ICON: r_draw_icon(cmd->icon.id, cmd->icon.rect, cmd->icon.color); break;
-              case MU_COMMAND_CLIP: r_set_clip_rect(cmd->clip.rect); break;
-          }
+        if (pipelined) {
+          swap_command_lists(ctx);
+        } else {
+          render_commands(ctx->command_list);
         }
-        r_present();    
+        if (startup_bench && r_first_present()) { quit = true; }
+        if (layout_bench && frames >= layout_bench) { quit = true; }
       //  quit=1;
     }
+    if (renderer) {
+      SDL_AtomicSet(&render_quit, 1);
+      SDL_SemPost(submitted);
+      SDL_WaitThread(renderer, NULL);
+      SDL_DestroySemaphore(submitted);
+      SDL_DestroySemaphore(slot_free);
+      SDL_DestroySemaphore(released);
+    }
+    if (threads > 1) { tp_shutdown(); }
+    ld_shutdown();
+    r_LayerStats layers = r_layer_stats();
+    printf("layers: %d hits, %d misses, %d evictions, %d held in %d bytes\n",
+           layers.hits, layers.misses, layers.evictions, layers.layers, layers.bytes);
+    r_DrawStats draws = r_draw_stats();
+    if (draws.frames > 0) {
+      printf("draws: %.1f flushes, %.1f clip changes per frame\n",
+             (double)draws.flushes / draws.frames, (double)draws.clips / draws.frames);
+    }
+    if (startup_bench) {
+      double ms = 1000.0 / SDL_GetPerformanceFrequency();
+      printf("startup: r_init %.2f ms, first frame %.2f ms after process start\n",
+             (init_end - init_start) * ms, (r_first_present() - process_start) * ms);
+    }
+    if (layout_bench && frames > 0) {
+      double ms = 1000.0 / SDL_GetPerformanceFrequency() / frames;
+      printf("layout: %d threads, %d elements, %.3f ms sizing and positioning, %.3f ms building per frame over %d frames\n",
+             threads, ctx->element_stack.idx, layout_ticks * ms, build_ticks * ms, frames);
+    }
+    if (thumbnail_path) {
+      r_ImageStats images = r_image_stats();
+      printf("images: %d uploads, %d evictions, %d bytes held\n",
+             images.uploads, images.evictions, images.bytes);
+    }
+    if (yuv_frames > 0) {
+      printf("yuv overlay (%s): %.3f ms per %dx%d NV12 frame\n", yuv_kernels(),
+             yuv_ticks * 1000.0 / SDL_GetPerformanceFrequency() / yuv_frames, YUV_WIDTH, YUV_HEIGHT);
+    }
+    if (occlusion && frames > 0) {
+      printf("occlusion: %.0f pixels per frame not drawn\n", (double)occluded_pixels / frames);
+    }
     return 0;
 }
\ No newline at end of file
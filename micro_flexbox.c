@@ -3,7 +3,6 @@
 #include <string.h>
 
 #include "micro_flexbox.h"
-#include <SDL2/SDL.h>
 
 
 #define unused(x) ((void) (x))
@@ -29,6 +28,15 @@
 
 
 static mu_Rect unclipped_rect = { 0, 0, 0x1000000, 0x1000000 };
+/* covers the screen under any translation a scroll container can apply */
+static mu_Rect reset_clip = { -0x800000, -0x800000, 0x1000000, 0x1000000 };
+
+/* bytes a command of type T takes in a command list */
+#define command_size(T) align_command((int) sizeof(T))
+
+static int align_command(int size) {
+  return (size + MU_COMMAND_ALIGN - 1) & ~(MU_COMMAND_ALIGN - 1);
+}
 
 
 static mu_Style default_style = {
@@ -42,7 +50,8 @@ static mu_Style default_style = {
   10010, /* text_align*/
   { 180, 200, 0, 255 }, /* hover_color */
   { 130, 200, 230, 255 }, /* focus_color */
-  {0,0}
+  {0,0},
+  0 /* radius */
 };
 
 /// @brief Initializes and returns a new 2D vector.
@@ -142,6 +151,31 @@ static int rect_overlaps_vec2(mu_Rect r, mu_Vec2 p) {
   return p.x >= r.x && p.x < r.x + r.w && p.y >= r.y && p.y < r.y + r.h;
 }
 
+static int rect_empty(mu_Rect r) {
+  return r.w <= 0 || r.h <= 0;
+}
+
+/* same area; all empty rects are the same */
+static int rect_same(mu_Rect a, mu_Rect b) {
+  if (rect_empty(a) || rect_empty(b)) { return rect_empty(a) && rect_empty(b); }
+  return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+static mu_Rect translate_rect(mu_Rect r, mu_Vec2 d) {
+  return mu_rect(r.x + d.x, r.y + d.y, r.w, r.h);
+}
+
+/// @brief Returns where an element ends up on screen.
+/// @param elem The element.
+/// @return The element's rect moved by the scroll of its ancestors.
+///
+/// Layout places elements in the local space of their scroll container. The
+/// scroll is only applied when drawing, through MU_COMMAND_TRANSLATE, and
+/// pointer tests move the pointer into local space instead.
+mu_Rect mu_screen_rect(mu_Elem *elem) {
+  return translate_rect(elem->rect, elem->offset);
+}
+
 
 
 /// @brief Initializes a MicroUI context.
@@ -153,6 +187,8 @@ void mu_init(mu_Context *ctx) {
   memset(ctx, 0, sizeof(*ctx));
   ctx->_style = default_style;
   ctx->style = &ctx->_style;
+  ctx->command_list = &ctx->_command_list;
+  ctx->parallel_threshold = MU_PARALLEL_THRESHOLD;
   
   ctx->tier=0;
 
@@ -167,9 +203,12 @@ void mu_init(mu_Context *ctx) {
 /// calculates the mouse movement delta, and increments the frame counter.
 void mu_begin(mu_Context *ctx) {
   expect(ctx->text_width && ctx->text_height);
-  ctx->command_list.idx = 0;
+  ctx->command_list->idx = 0;
+  ctx->command_list->text = MU_COMMANDLIST_SIZE - MU_SEGCACHE_SIZE;
   ctx->element_stack.idx=0;
   ctx->current_parent=NULL;
+  ctx->has_next_key=0;
+  ctx->memo_used=0;
 
   ctx->mouse_delta.x = ctx->mouse_pos.x - ctx->last_mouse_pos.x;
   ctx->mouse_delta.y = ctx->mouse_pos.y - ctx->last_mouse_pos.y;
@@ -180,6 +219,8 @@ void mu_begin(mu_Context *ctx) {
 }
 
 
+static void collect_states(mu_Context *ctx, int max_age);
+
 /// @brief Finalizes a UI frame.
 /// @param ctx The context to finalize.
 ///
@@ -188,15 +229,27 @@ void mu_begin(mu_Context *ctx) {
 /// stack consistency, handles scroll input, manages focus and hover states,
 /// resets input variables and
 /// links their command lists to ensure a correct drawing order.
+/// The frame delta is taken from `ctx->clock` in nanoseconds. Without a clock
+/// every frame counts as one fixed step, which makes runs fully reproducible.
 void mu_end(mu_Context *ctx) {
   /* check stacks */
   expect(ctx->clip_stack.idx      == 0);
   expect(ctx->id_stack.idx        == 0);
+  expect(ctx->memo_stack.idx      == 0);
 
   /* STORE TIME*/
-  ctx->dt = (SDL_GetTicks() - ctx->last_time);
-  ctx->last_time = SDL_GetTicks();
-  // printf("dt %d, last_time %d\n", ctx->dt, ctx->last_time);
+  if (ctx->clock) {
+    mu_Time now = ctx->clock();
+    ctx->dt = ctx->last_time ? now - ctx->last_time : 0; // first frame has no delta
+    ctx->last_time = now;
+  } else {
+    ctx->dt = ctx->fixed_step ? ctx->fixed_step : MU_DEFAULT_STEP;
+    ctx->last_time += ctx->dt;
+  }
+  /* drop state of vanished ids, harder when the table fills up */
+  collect_states(ctx, MU_STATE_MAXAGE);
+  if (ctx->state_count > MU_STATETABLE_SIZE / 2) { collect_states(ctx, 0); }
+
   /* reset input state */
   ctx->key_pressed = 0;
   ctx->input_text[0] = '\0';
@@ -336,30 +389,75 @@ int mu_check_clip_ex(mu_Rect r, mu_Rect cr) {
 
 
 
-static mu_StyleOverride* get_override(mu_Context *ctx,mu_Id id) {
-    mu_StyleOverride *override;
-  /* try to get existing overrde from pool */
-  int idx = mu_pool_get(ctx, ctx->override_pool, MU_ELEMENTPOOL_SIZE, id);
-  if (idx >= 0) {
-      mu_pool_update(ctx, ctx->override_pool,  idx);
-    return &ctx->overrides[idx];
-  }
-  /* overrde not found in pool: init new container */
-  // printf("ADDING ANIM\n");
-  idx = mu_pool_init(ctx, ctx->override_pool, MU_ELEMENTPOOL_SIZE, id);
-  // printf("adding new override with idx %d and id %d\n", idx, ctx->override_pool[idx].id);
+/*============================================================================
+** retained state
+**============================================================================*/
 
-  override = &ctx->overrides[idx]; 
-  mu_Elem* new_elem=&ctx->element_stack.items[ctx->element_stack.idx];
-  
-  memcpy( &override->border_color,&new_elem->style, sizeof(mu_Style));
+static mu_ElemState *state_probe(mu_Context *ctx, mu_Id id) {
+  unsigned mask = MU_STATETABLE_SIZE - 1;
+  unsigned i = id & mask;
+  while (ctx->state_table[i].id && ctx->state_table[i].id != id) { i = (i + 1) & mask; }
+  return &ctx->state_table[i];
+}
 
-  // memset(override, 0, sizeof(*override));
-  return override;
+/// @brief Looks up the retained state of an id without creating it.
+/// @param ctx The MicroUI context.
+/// @param id The element id.
+/// @return The state, or NULL if the id has none.
+mu_ElemState *mu_find_state(mu_Context *ctx, mu_Id id) {
+  mu_ElemState *st = state_probe(ctx, id);
+  return st->id ? st : NULL;
+}
+
+/// @brief Returns the retained state of an id, creating it on first use.
+/// @param ctx The MicroUI context.
+/// @param id The element id, never 0.
+///
+/// The table is open-addressed with linear probing; ids are already well
+/// mixed, so their low bits pick the home slot. Looking an id up marks it as
+/// seen in the current frame.
+mu_ElemState *mu_get_state(mu_Context *ctx, mu_Id id) {
+  mu_ElemState *st = state_probe(ctx, id);
+  if (!st->id) {
+    expect(ctx->state_count < MU_STATETABLE_SIZE - 1);
+    memset(st, 0, sizeof(*st));
+    st->id = id;
+    st->anim = -1;
+    ctx->state_count++;
+  }
+  st->last_frame = ctx->frame;
+  return st;
+}
+
+/* removes slot i, shifting the rest of its probe run back so no tombstone is left */
+static void state_remove(mu_Context *ctx, unsigned i) {
+  unsigned mask = MU_STATETABLE_SIZE - 1;
+  unsigned j = i;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (!ctx->state_table[j].id) { break; }
+    unsigned home = ctx->state_table[j].id & mask;
+    /* entry j may fill the hole unless its home lies between the hole and j */
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      ctx->state_table[i] = ctx->state_table[j];
+      i = j;
+    }
+  }
+  ctx->state_table[i].id = 0;
+  ctx->state_count--;
+}
+
+/* drops the state of ids not seen for more than max_age frames */
+static void collect_states(mu_Context *ctx, int max_age) {
+  for (unsigned i = 0; i < MU_STATETABLE_SIZE; i++) {
+    mu_ElemState *st = &ctx->state_table[i];
+    /* re-check slot i after a removal, another entry may have moved into it */
+    while (st->id && st->anim < 0 && ctx->frame - st->last_frame > max_age) { state_remove(ctx, i); }
+  }
 }
 
 mu_StyleOverride* mu_get_override(mu_Context *ctx,mu_Id hash) {
-  return get_override(ctx,hash);
+  return &mu_get_state(ctx,hash)->anim_override;
 }
 
 
@@ -499,15 +597,72 @@ void mu_input_text(mu_Context *ctx, const char *text) {
 /// This function adds a new command of the specified type and size to the
 /// context's command list buffer. It handles the necessary pointer arithmetic
 /// and checks for buffer overflow before returning a pointer to the new command.
+/// The size is rounded up to MU_COMMAND_ALIGN so the next command is aligned.
 mu_Command* mu_push_command(mu_Context *ctx, int type, int size) {
-  mu_Command *cmd = (mu_Command*) (ctx->command_list.items + ctx->command_list.idx);
-  expect(ctx->command_list.idx + size < MU_COMMANDLIST_SIZE);
+  mu_Command *cmd = (mu_Command*) (ctx->command_list->items + ctx->command_list->idx);
+  size = align_command(size);
+  expect(ctx->command_list->idx + size <= ctx->command_list->text);
   cmd->base.type = type;
   cmd->base.size = size;
-  ctx->command_list.idx += size;
+  ctx->command_list->idx += size;
   return cmd;
 }
 
+/// @brief Pushes a new command into a command segment.
+/// @param seg The segment to write into.
+/// @param type The type of command to push.
+/// @param size The total size of the command in bytes.
+/// @return A pointer to the newly pushed command.
+///
+/// Same as `mu_push_command`, but writes into a private segment so several
+/// threads can generate commands at once.
+static mu_Command* push_segment_command(mu_CommandSegment *seg, int type, int size) {
+  mu_Command *cmd = (mu_Command*) (seg->base + seg->idx);
+  size = align_command(size);
+  expect(seg->idx + size <= seg->text);
+  cmd->base.type = type;
+  cmd->base.size = size;
+  seg->idx += size;
+  return cmd;
+}
+
+/// @brief Copies a string into the string area of the frame's command list.
+/// @param ctx The MicroUI context.
+/// @param str The string to copy.
+/// @param len The number of bytes to copy.
+/// @return The NUL-terminated copy, valid as long as the command list is.
+///
+/// Strings grow down from the top of the list, towards its commands, so text
+/// commands keep a fixed size and stay aligned.
+static const char *push_text(mu_Context *ctx, const char *str, int len) {
+  mu_CommandList *list = ctx->command_list;
+  char *dst;
+  expect(list->idx + len + 1 <= list->text);
+  list->text -= len + 1;
+  dst = list->items + list->text;
+  memcpy(dst, str, len);
+  dst[len] = '\0';
+  return dst;
+}
+
+/// @brief Copies a string into the top end of a command segment.
+/// @param seg The segment the referencing command is written into.
+/// @param str The string to copy.
+/// @param len The number of bytes to copy.
+/// @return The NUL-terminated copy.
+///
+/// Same as `push_text`. The copy lives with the segment, so a segment kept in
+/// the cache for later frames keeps its strings too.
+static const char *push_segment_text(mu_CommandSegment *seg, const char *str, int len) {
+  char *dst;
+  expect(seg->idx + len + 1 <= seg->text);
+  seg->text -= len + 1;
+  dst = seg->base + seg->text;
+  memcpy(dst, str, len);
+  dst[len] = '\0';
+  return dst;
+}
+
 /// @brief Iterates to the next command in the command list.
 /// @param ctx The MicroUI context.
 /// @param cmd A pointer to a mu_Command pointer. On the first call, this
@@ -520,12 +675,23 @@ mu_Command* mu_push_command(mu_Context *ctx, int type, int size) {
 /// advances the command pointer to the next valid command, automatically
 /// handling MU_COMMAND_JUMP commands by skipping to their destination.
 int mu_next_command(mu_Context *ctx, mu_Command **cmd) {
+  return mu_next_command_ex(ctx->command_list, cmd);
+}
+
+/// @brief Iterates to the next command of a detached command list.
+/// @param list The command list to walk.
+/// @param cmd Iterator state, see `mu_next_command`.
+/// @return Returns 1 if a command was found, or 0 at the end of the list.
+///
+/// Used by a render thread that replays a finished frame while the context
+/// already builds the next one into a different list.
+int mu_next_command_ex(mu_CommandList *list, mu_Command **cmd) {
   if (*cmd) {
     *cmd = (mu_Command*) (((char*) *cmd) + (*cmd)->base.size);
   } else {
-    *cmd = (mu_Command*) ctx->command_list.items;
+    *cmd = (mu_Command*) list->items;
   }
-  while ((char*) *cmd != ctx->command_list.items + ctx->command_list.idx) {
+  while ((char*) *cmd != list->items + list->idx) {
     if ((*cmd)->type != MU_COMMAND_JUMP) { return 1; }
     *cmd = (*cmd)->jump.dst;
   }
@@ -565,11 +731,53 @@ void mu_draw_rect(mu_Context *ctx, mu_Rect rect, mu_Color color) {
   }
 }
 
-void mu_draw_debug_clip_rect(mu_Context *ctx, mu_Rect rect, mu_Rect clip_rect, mu_Color color) {
+/* the clip command is left out when the renderer already clips to rect */
+static void segment_set_clip(mu_CommandSegment *seg, mu_Rect rect) {
+  mu_Command *cmd;
+  if (!memcmp(&seg->clip, &rect, sizeof(rect))) { return; }
+  cmd = push_segment_command(seg, MU_COMMAND_CLIP, sizeof(mu_ClipCommand));
+  cmd->clip.rect = rect;
+  seg->clip = rect;
+}
+
+/// @brief Makes the renderer clip a draw of `rect` the way `clip` would.
+/// @param seg The segment the draw is written into.
+/// @param rect The bounds of the draw.
+/// @param clip The clip rectangle the draw needs.
+///
+/// The clip a segment left the renderer at is kept as long as it shows the
+/// same part of `rect`, so siblings under one container share a single clip
+/// command and fully visible draws need none. Otherwise the clip becomes
+/// `clip`, which the following draws of the container are likely to share.
+static void segment_clip(mu_CommandSegment *seg, mu_Rect rect, mu_Rect clip) {
+  if (rect_same(intersect_rects(rect, seg->clip), intersect_rects(rect, clip))) { return; }
+  segment_set_clip(seg, clip);
+}
+
+/* every segment is entered and left unclipped, e.g. before a jump to another
+ * segment or a layer the renderer may skip */
+static void segment_unclip(mu_CommandSegment *seg) {
+  segment_set_clip(seg, reset_clip);
+}
+
+/* moves the renderer's translation from *at to offset, if they differ */
+static void segment_translate(mu_CommandSegment *seg, mu_Vec2 *at, mu_Vec2 offset) {
+  mu_Command *cmd;
+  mu_Vec2 delta = mu_vec2(offset.x - at->x, offset.y - at->y);
+  if (delta.x == 0 && delta.y == 0) { return; }
+  cmd = push_segment_command(seg, MU_COMMAND_TRANSLATE, sizeof(mu_TranslateCommand));
+  cmd->translate.offset = delta;
+  *at = offset;
+  /* the clip stays where it is on screen */
+  if (memcmp(&seg->clip, &reset_clip, sizeof(reset_clip))) { seg->clip = translate_rect(seg->clip, mu_vec2(-delta.x, -delta.y)); }
+}
+
+void mu_draw_debug_clip_rect(mu_CommandSegment *seg, mu_Rect rect, mu_Rect clip_rect, mu_Color color) {
   mu_Command *cmd;
   rect = intersect_rects(rect, clip_rect);
   if (rect.w > 0 && rect.h > 0) {
-    cmd = mu_push_command(ctx, MU_COMMAND_RECT, sizeof(mu_RectCommand));
+    segment_clip(seg, rect, reset_clip);
+    cmd = push_segment_command(seg, MU_COMMAND_RECT, sizeof(mu_RectCommand));
     cmd->rect.rect = rect;
     cmd->rect.color = color;
   }
@@ -594,14 +802,57 @@ void mu_draw_outline_ex(mu_Context *ctx, mu_Rect rect, mu_Color color, int t) {
 }
 
 
-void mu_draw_debug_clip_outline_ex(mu_Context *ctx, mu_Rect rect,  mu_Rect clip_rect, mu_Color color, int t) {
-  mu_draw_debug_clip_rect(ctx, mu_rect(rect.x - t, rect.y - t, rect.w + (t * 2), t),clip_rect, color); // top line
-  mu_draw_debug_clip_rect(ctx, mu_rect(rect.x - t, rect.y + rect.h, rect.w + (t * 2), t),clip_rect, color); // bottom line
-  mu_draw_debug_clip_rect(ctx, mu_rect(rect.x - t, rect.y, t, rect.h),clip_rect, color); // left line
-  mu_draw_debug_clip_rect(ctx, mu_rect(rect.x + rect.w, rect.y, t, rect.h),clip_rect, color); // right line
+static void fill_box(mu_Command *cmd, mu_Rect rect, mu_Color color, mu_Color border_color, int border, int radius) {
+  cmd->box.rect = rect;
+  cmd->box.color = color;
+  cmd->box.border_color = border_color;
+  cmd->box.border = mu_max(border, 0);
+  cmd->box.radius = mu_max(radius, 0);
 }
 
+/// @brief Adds a command to draw a filled box with a border and rounded corners.
+/// @param ctx The MicroUI context.
+/// @param rect The outer rectangle, the border is drawn inside it.
+/// @param color The fill color, transparent for an outline only.
+/// @param border_color The color of the border.
+/// @param border The border width in pixels.
+/// @param radius The corner radius in pixels.
+///
+/// The box is one MU_COMMAND_BOX which the renderer draws as a single quad.
+/// Since the shape is not clipped on the CPU, a partially clipped box is
+/// enclosed in clip commands.
+void mu_draw_box(mu_Context *ctx, mu_Rect rect, mu_Color color, mu_Color border_color, int border, int radius) {
+  mu_Command *cmd;
+  int clipped = mu_check_clip(ctx, rect);
+  if (clipped == MU_CLIP_ALL) { return; }
+  if (clipped == MU_CLIP_PART) { mu_set_clip(ctx, mu_get_clip_rect(ctx)); }
+  cmd = mu_push_command(ctx, MU_COMMAND_BOX, sizeof(mu_BoxCommand));
+  fill_box(cmd, rect, color, border_color, border, radius);
+  if (clipped) { mu_set_clip(ctx, unclipped_rect); }
+}
 
+/* mu_draw_box for a segment; nothing is emitted when nothing would be visible */
+static void segment_box(mu_CommandSegment *seg, mu_Rect rect, mu_Rect clip, mu_Color color, mu_Color border_color, int border, int radius) {
+  mu_Command *cmd;
+  if (border <= 0 && color.a == 0) { return; }
+  if (rect_empty(intersect_rects(rect, clip))) { return; }
+  segment_clip(seg, rect, clip);
+  cmd = push_segment_command(seg, MU_COMMAND_BOX, sizeof(mu_BoxCommand));
+  fill_box(cmd, rect, color, border_color, border, radius);
+}
+
+
+
+static void fill_text(mu_Command *cmd, mu_Font font, const char *str, int len, int width, mu_Vec2 pos, mu_Color color) {
+  cmd->text.font = font;
+  cmd->text.str = str;
+  cmd->text.len = len;
+  cmd->text.width = width;
+  cmd->text.hash = HASH_INITIAL;
+  hash(&cmd->text.hash, str, len);
+  cmd->text.pos = pos;
+  cmd->text.color = color;
+}
 
 /// @brief Adds a command to draw text.
 /// @param ctx The MicroUI context.
@@ -614,38 +865,51 @@ void mu_draw_debug_clip_outline_ex(mu_Context *ctx, mu_Rect rect,  mu_Rect clip_
 /// This function calculates the bounding box of the text and checks if it needs
 /// to be clipped. It returns early if the text is completely outside the clip
 /// rectangle. If the text is visible, it adds a text drawing command to the
-/// command list. The command includes the string data itself, which is copied
-/// into the command buffer. The function also handles resetting the clipping
-/// state if it was temporarily modified
+/// command list. The string is copied into the string area of the command
+/// list, the command itself only references it along with its measured width
+/// and hash. The function also handles resetting the clipping state if it was
+/// temporarily modified
 void mu_draw_text(mu_Context *ctx, mu_Font font, const char *str, int len,
   mu_Vec2 pos, mu_Color color)
 {
   mu_Command *cmd;
-  mu_Rect rect = mu_rect(
-    pos.x, pos.y, ctx->text_width(font, str, len), ctx->text_height(font));
-  int clipped = mu_check_clip(ctx, rect);
+  mu_Rect rect;
+  int clipped;
+  if (len < 0) { len = strlen(str); }
+  rect = mu_rect(pos.x, pos.y, ctx->text_width(font, str, len), ctx->text_height(font));
+  clipped = mu_check_clip(ctx, rect);
   if (clipped == MU_CLIP_ALL ) { return; }
   if (clipped == MU_CLIP_PART) { mu_set_clip(ctx, mu_get_clip_rect(ctx)); }
   /* add command */
-  if (len < 0) { len = strlen(str); }
-  cmd = mu_push_command(ctx, MU_COMMAND_TEXT, sizeof(mu_TextCommand) + len);
-  memcpy(cmd->text.str, str, len);
-  cmd->text.str[len] = '\0';
-  cmd->text.pos = pos;
-  cmd->text.color = color;
-  cmd->text.font = font;
+  cmd = mu_push_command(ctx, MU_COMMAND_TEXT, sizeof(mu_TextCommand));
+  fill_text(cmd, font, push_text(ctx, str, len), len, rect.w, pos, color);
   /* reset clipping if it was set */
   if (clipped) { mu_set_clip(ctx, unclipped_rect); }
 }
 
 
 
-
-void mu_draw_text_ex(mu_Context *ctx, mu_Font font, const char *str, int len,
+/// @brief Adds a command to draw aligned text into a command segment.
+/// @param ctx The MicroUI context.
+/// @param seg The segment to write into.
+/// @param font The font to use for drawing the text.
+/// @param str The string to draw.
+/// @param len The length of the string, or a negative value to use `strlen`.
+/// @param copy Nonzero when `str` may not outlive the command list, it is then
+///        copied into the segment. Otherwise the command points at `str`, which
+///        has to be NUL-terminated at `len`.
+/// @param pos The top left corner of `parent`.
+/// @param color The color of the text.
+/// @param clip The clip rectangle of the text.
+/// @param parent The rectangle the text is aligned in.
+/// @param textAlignment MU_ALIGN_* flags.
+/// @param padding Space kept between the text and `parent`.
+void mu_draw_text_ex(mu_Context *ctx, mu_CommandSegment *seg, mu_Font font, const char *str, int len, int copy,
   mu_Vec2 pos, mu_Color color, mu_Rect clip,mu_Rect parent,int textAlignment,int padding)
 {
 
   mu_Command *cmd;
+  int width;
 
     mu_fVec2 m;
   if (textAlignment & MU_ALIGN_LEFT)   m.x = 0.0f;
@@ -654,30 +918,24 @@ void mu_draw_text_ex(mu_Context *ctx, mu_Font font, const char *str, int len,
   if (textAlignment & MU_ALIGN_TOP)    m.y = 0.0f;
   if (textAlignment & MU_ALIGN_MIDDLE) m.y = 0.5f;
   if (textAlignment & MU_ALIGN_BOTTOM) m.y = 1.0f;
-  
-  pos.x+= (parent.w - (ctx->text_width(font, str, len)+2*padding))*m.x+padding;
+
+  if (len < 0) { len = strlen(str); }
+  width = ctx->text_width(font, str, len);
+  pos.x+= (parent.w - (width+2*padding))*m.x+padding;
   pos.y+= (parent.h - (ctx->text_height(font)         +2*padding))*m.y + padding;
 
 
   mu_Rect rect = mu_rect(
-    pos.x, pos.y, ctx->text_width(font, str, len), ctx->text_height(font));
+    pos.x, pos.y, width, ctx->text_height(font));
   int clipped = mu_check_clip_ex(rect, clip);
   // printf("checking clip of text %s in rect %d %d %d %d against clip: %d %d %d %d. returned %d \n ", str,rect.x,rect.y,rect.w,rect.h,clip.x,clip.y,clip.w,clip.h,clipped);
   // mu_draw_rect(ctx,rect,mu_color(255,0,0,50));
 
   if (clipped == MU_CLIP_ALL ) { return; }
   /* add command */
-  if (clipped == MU_CLIP_PART) { mu_set_clip(ctx, clip); }
-
-  if (len < 0) { len = strlen(str); }
-  cmd = mu_push_command(ctx, MU_COMMAND_TEXT, sizeof(mu_TextCommand) + len);
-  memcpy(cmd->text.str, str, len);
-  cmd->text.str[len] = '\0';
-  cmd->text.pos = pos;
-  cmd->text.color = color;
-  cmd->text.font = font;
-  /* reset clipping if it was set */
-  if (clipped) { mu_set_clip(ctx, unclipped_rect); }
+  segment_clip(seg, rect, clip);
+  cmd = push_segment_command(seg, MU_COMMAND_TEXT, sizeof(mu_TextCommand));
+  fill_text(cmd, font, copy ? push_segment_text(seg, str, len) : str, len, width, pos, color);
 }
 
 /// @brief Adds a command to draw an icon.
@@ -707,6 +965,40 @@ void mu_draw_icon(mu_Context *ctx, int id, mu_Rect rect, mu_Color color) {
 }
 
 
+static void fill_image(mu_Command *cmd, mu_Image image, mu_Rect rect, mu_Color color) {
+  cmd->image.image = image;
+  cmd->image.rect = rect;
+  cmd->image.color = color;
+}
+
+/// @brief Adds a command to draw an image.
+/// @param ctx The MicroUI context.
+/// @param image The renderer's handle of the image.
+/// @param rect The rectangle the image is stretched over.
+/// @param color Only the alpha is used, to fade the image.
+///
+/// Clipped like `mu_draw_icon`. The renderer draws nothing for an image that
+/// is not loaded yet, so the frame never waits on it.
+void mu_draw_image(mu_Context *ctx, mu_Image image, mu_Rect rect, mu_Color color) {
+  mu_Command *cmd;
+  int clipped = mu_check_clip(ctx, rect);
+  if (clipped == MU_CLIP_ALL) { return; }
+  if (clipped == MU_CLIP_PART) { mu_set_clip(ctx, mu_get_clip_rect(ctx)); }
+  cmd = mu_push_command(ctx, MU_COMMAND_IMAGE, sizeof(mu_ImageCommand));
+  fill_image(cmd, image, rect, color);
+  if (clipped) { mu_set_clip(ctx, unclipped_rect); }
+}
+
+/* mu_draw_image for a segment */
+static void segment_image(mu_CommandSegment *seg, mu_Image image, mu_Rect rect, mu_Rect clip, mu_Color color) {
+  mu_Command *cmd;
+  if (rect_empty(intersect_rects(rect, clip))) { return; }
+  segment_clip(seg, rect, clip);
+  cmd = push_segment_command(seg, MU_COMMAND_IMAGE, sizeof(mu_ImageCommand));
+  fill_image(cmd, image, rect, color);
+}
+
+
 /*============================================================================
 ** layout
 **============================================================================*/
@@ -757,8 +1049,11 @@ void mu_update_element_control(mu_Context *ctx, mu_Elem* elem) {
 
   unsigned int id = elem->hash;
   mu_Rect rect = elem->rect;
-  int mouseover = mu_mouse_over(ctx, rect);
-  int fingerover = mu_finger_over(ctx, rect);
+  /* the pointer is moved into the element's local space, the clip is on screen */
+  mu_Vec2 mouse = mu_vec2(ctx->mouse_pos.x - elem->offset.x, ctx->mouse_pos.y - elem->offset.y);
+  mu_Vec2 finger = mu_vec2(ctx->finger_pos.x - elem->offset.x, ctx->finger_pos.y - elem->offset.y);
+  int mouseover = rect_overlaps_vec2(rect, mouse) && rect_overlaps_vec2(elem->clip, ctx->mouse_pos);
+  int fingerover = rect_overlaps_vec2(rect, finger) && rect_overlaps_vec2(elem->clip, ctx->finger_pos);
   elem->state=MU_STATE_ACTIVE;
 
   if (fingerover&& ctx->finger_pressed) {
@@ -811,44 +1106,71 @@ void mu_update_element_control(mu_Context *ctx, mu_Elem* elem) {
 
 
 
-const char *int_to_str(int value) {
-    static char buffer[12];  // reused on each call
-    char *p = buffer;
-    char *p1, *p2;
-    unsigned int u = value;
+/* Integer id of an element: a mix of its parent's id with either its sibling
+ * ordinal or a user key. Keys are salted so key 3 never collides with ordinal
+ * 3. Inserting an element only changes the ids of its later siblings and
+ * their subtrees; keyed elements keep theirs wherever they move. */
+static mu_Id mix_id(mu_Id parent, unsigned v, int keyed) {
+  mu_Id h = v ^ (keyed ? 0x85ebca6bu : 0);
+  h = parent ^ (h * 0x9e3779b9u + 0x7f4a7c15u + (parent << 6) + (parent >> 2));
+  h ^= h >> 16; h *= 0x7feb352du;
+  h ^= h >> 15; h *= 0x846ca68bu;
+  h ^= h >> 16;
+  return h;
+}
 
-    if (value < 0) {
-        *p++ = '-';
-        u = -value;
-    }
+/// @brief Sets the key of the next element.
+/// @param ctx The MicroUI context.
+/// @param key A value unique among the element's siblings, e.g. an item index.
+///
+/// By default an element is identified by its position among its siblings.
+/// Keyed elements keep their id, and with it their overrides and animations,
+/// when siblings are inserted or removed before them.
+void mu_key(mu_Context *ctx, mu_Id key) {
+  ctx->next_key = key;
+  ctx->has_next_key = 1;
+}
 
-    p1 = p;
-    do {
-        *p++ = (u % 10) + '0';
-        u /= 10;
-    } while (u > 0);
 
-    *p = '\0';
 
-    // reverse the digits
-    p2 = p - 1;
-    while (p1 < p2) {
-        char tmp = *p1;
-        *p1++ = *p2;
-        *p2-- = tmp;
-    }
-    return buffer;  // caller gets pointer
+
+/* id the element begun next at element_stack index `index` will get */
+static mu_Id next_elem_id(mu_Context *ctx, int index) {
+  mu_Id id;
+  if (ctx->tier!=0){
+    mu_Id parent=ctx->current_parent->hash;
+    id=ctx->has_next_key ? mix_id(parent,ctx->next_key,1) : mix_id(parent,ctx->current_parent->tree.count,0);
+  } else {
+    mu_Id scope=(ctx->id_stack.idx > 0) ? ctx->id_stack.items[ctx->id_stack.idx - 1] : HASH_INITIAL;
+    id=ctx->has_next_key ? mix_id(scope,ctx->next_key,1) : mix_id(scope,index,0);
+  }
+  return id ? id : 1; // 0 marks free state slots
+}
+
+/* links an element to the state retained for its id */
+static void attach_state(mu_Context *ctx, mu_Elem *elem) {
+  if (!mu_find_state(ctx,elem->hash)) {
+    /* first sighting: the animated style starts out as the element's style */
+    memcpy(&mu_get_state(ctx,elem->hash)->anim_override.border_color,&elem->style,sizeof(mu_Style));
+  }
+  elem->retained=mu_get_state(ctx,elem->hash);
+  elem->anim_override=&elem->retained->anim_override;
+  elem->state=elem->retained->state;
+  elem->cooldown=elem->retained->cooldown;
 }
 
 
 
+
 int mu_begin_elem_ex(mu_Context *ctx, float sizex,float sizey, mu_Dir direction,int alignopts, int settings) {
   // push(ctx->element_stack,emptyelem); // THIS BREAKS THINGS
 
+  expect(ctx->element_stack.idx < MU_ELEMENTSTACK_SIZE);
   int newindex=ctx->element_stack.idx++;
   mu_Elem*new_elem=&ctx->element_stack.items[newindex];
     // fill with values
   
+  new_elem->hash=next_elem_id(ctx,newindex); // before the tier moves down
   new_elem->tree.count=0;
   new_elem->tree.parent=-1;
   new_elem->idx=newindex; //set element id after we pushed it
@@ -859,13 +1181,16 @@ int mu_begin_elem_ex(mu_Context *ctx, float sizex,float sizey, mu_Dir direction,
   new_elem->direction=direction;
   new_elem->sizing=(mu_fVec2){sizex,sizey};
   new_elem->clip=(mu_Rect){0,0,0,0};
-  const void *data = int_to_str(new_elem->idx);
-  const char *s = (const char *)data;  // "12345"
-  new_elem->hash=mu_get_id(ctx,s , strlen(s));
-  new_elem->anim_override=mu_get_override(ctx,new_elem->hash);
+  new_elem->offset=mu_vec2(0,0);
+  new_elem->data=NULL;
+  new_elem->text.str=NULL;
+  new_elem->image=NULL;
+  ctx->has_next_key=0;
+  attach_state(ctx,new_elem);
 
 
   if (new_elem->tier!=0){
+    expect(ctx->current_parent->tree.count < MU_MAX_CHILDREN);
     new_elem->tree.parent= ctx->current_parent->idx;
     ctx->current_parent->tree.children[ctx->current_parent->tree.count++]=new_elem->idx;
   } {
@@ -889,10 +1214,128 @@ void mu_end_elem(mu_Context *ctx) {
 
   }
   ctx->tier--;
+  ctx->current_parent->tree.end = ctx->element_stack.idx;
   ctx->current_parent = &ctx->element_stack.items[ctx->current_parent->tree.parent];
 
 }
 
+/*============================================================================
+** memoization
+**============================================================================*/
+
+static mu_Id style_hash(const mu_Style *style);
+
+/* copies element records and shifts every index in them by `delta` */
+static void copy_elems(mu_Elem *dst, const mu_Elem *src, int count, int delta, int tier) {
+  for (int i = 0; i < count; i++) {
+    mu_Elem *e = &dst[i];
+    *e = src[i];
+    e->idx += delta;
+    e->tier += tier;
+    e->tree.end += delta;
+    if (e->tree.parent >= 0) { e->tree.parent += delta; }
+    for (int c = 0; c < e->tree.count; c++) { e->tree.children[c] += delta; }
+  }
+}
+
+/// @brief Begins a memoized range of elements.
+/// @param ctx The MicroUI context.
+/// @param key Identifies the range, e.g. `mu_get_id(ctx, title, len)`.
+/// @param inputs_hash A hash of everything the builder code reads, including
+/// `ctx->font_generation` if it measures text.
+/// @return Returns 1 if the builder has to run, or 0 if the range was replayed.
+///
+/// If the key was seen last frame with the same inputs, under the same style
+/// and at an equivalent place in the tree, its element records are copied into
+/// `element_stack` and only their interaction state and animation overrides
+/// are looked up again. Otherwise the caller builds the range and closes it
+/// with mu_end_memo:
+///
+///     if (mu_begin_memo(ctx, key, inputs)) { ...; mu_end_memo(ctx); }
+///
+/// The builder must leave the element and style stacks balanced. Callbacks
+/// queued with mu_animation_set inside it are not replayed, so anything that
+/// depends on an element's state belongs outside the memoized range. Replayed
+/// records keep the text pointers of the frame that built them; a caller
+/// whose strings do not outlive that frame points them at the current ones.
+int mu_begin_memo(mu_Context *ctx, mu_Id key, mu_Id inputs_hash) {
+  int base = ctx->element_stack.idx;
+  mu_Id first = next_elem_id(ctx, base);
+  mu_Id style = style_hash(ctx->style);
+  mu_Memo *m;
+  int n;
+  if (!key) { key = 1; } // 0 marks free pool slots
+  n = mu_pool_get(ctx, ctx->memo_pool, MU_MEMOPOOL_SIZE, key);
+  if (n >= 0) {
+    m = &ctx->memos[n];
+    if ((m->frame == ctx->frame - 1 || m->frame == ctx->frame) && m->inputs == inputs_hash && m->style == style && m->first == first) {
+      mu_Elem *src = &ctx->memo_arena[m->frame & 1][m->start];
+      mu_Elem *parent = ctx->current_parent;
+      expect(base + m->count <= MU_ELEMENTSTACK_SIZE);
+      copy_elems(&ctx->element_stack.items[base], src, m->count, base, ctx->tier);
+      for (int i = base; i < base + m->count; i++) {
+        mu_Elem *e = &ctx->element_stack.items[i];
+        if (e->tree.parent < 0 && ctx->tier != 0) {
+          expect(parent->tree.count < MU_MAX_CHILDREN);
+          e->tree.parent = parent->idx;
+          parent->tree.children[parent->tree.count++] = i;
+        }
+        e->clip = (mu_Rect){0,0,0,0};
+        e->offset = mu_vec2(0,0);
+        attach_state(ctx, e);
+      }
+      ctx->element_stack.idx += m->count;
+      ctx->has_next_key = 0;
+      if (m->frame != ctx->frame) {
+        /* carry the records over into this frame's arena */
+        if (ctx->memo_used + m->count <= MU_MEMOARENA_SIZE) {
+          memcpy(&ctx->memo_arena[ctx->frame & 1][ctx->memo_used], src, m->count * sizeof(mu_Elem));
+          m->start = ctx->memo_used;
+          ctx->memo_used += m->count;
+          m->frame = ctx->frame;
+        }
+      }
+      mu_pool_update(ctx, ctx->memo_pool, n);
+      return 0;
+    }
+    mu_pool_update(ctx, ctx->memo_pool, n);
+  } else {
+    n = mu_pool_init(ctx, ctx->memo_pool, MU_MEMOPOOL_SIZE, key);
+  }
+  m = &ctx->memos[n];
+  m->inputs = inputs_hash;
+  m->style = style;
+  m->first = first;
+  m->frame = -1; // not replayable until mu_end_memo stored the records
+  m->start = base;
+  push(ctx->memo_stack, n);
+  return 1;
+}
+
+/// @brief Ends a memoized range and caches its element records.
+/// @param ctx The MicroUI context.
+///
+/// Only called when mu_begin_memo returned 1. The records are stored with
+/// indices relative to the start of the range; if the arena is full the range
+/// is simply built again next frame.
+void mu_end_memo(mu_Context *ctx) {
+  mu_Memo *m;
+  int count;
+  expect(ctx->memo_stack.idx > 0);
+  m = &ctx->memos[ctx->memo_stack.items[--ctx->memo_stack.idx]];
+  count = ctx->element_stack.idx - m->start;
+  if (ctx->memo_used + count > MU_MEMOARENA_SIZE) { return; }
+  mu_Elem *dst = &ctx->memo_arena[ctx->frame & 1][ctx->memo_used];
+  copy_elems(dst, &ctx->element_stack.items[m->start], count, -m->start, -ctx->tier);
+  for (int i = 0; i < count; i++) {
+    if (dst[i].tree.parent < 0) { dst[i].tree.parent = -1; } // roots of the range
+  }
+  m->start = ctx->memo_used;
+  m->count = count;
+  m->frame = ctx->frame;
+  ctx->memo_used += count;
+}
+
 void mu_resize_children(mu_Context *ctx,mu_Elem* elem) {
   if (elem->tree.count){
     float totalChildSize = 0;
@@ -938,7 +1381,117 @@ void mu_resize_children(mu_Context *ctx,mu_Elem* elem) {
   } 
 }
 
+/* a subtree handed to a layout worker, or a batch of small ones */
+typedef struct {
+  mu_Context *ctx;
+  int jobs[MU_ELEMENTSTACK_SIZE];
+  int njobs;
+  int inline_jobs[MU_ELEMENTSTACK_SIZE];
+  int ninline;
+} LayoutJobs;
+
+static void resize_subtree(mu_Context *ctx, mu_Elem *elem) {
+  for (int i = elem->idx; i < elem->tree.end; i++) {
+    mu_resize_children(ctx, &ctx->element_stack.items[i]);
+  }
+}
+
+static void place_children(mu_Context *ctx, mu_Elem *elem, mu_Rect clip);
+
+/* the clip handed to the children of elem; the root itself stays unclipped */
+static mu_Rect content_clip(mu_Elem *elem) {
+  return intersect_rects(mu_screen_rect(elem), elem->idx == 0 ? unclipped_rect : elem->clip);
+}
+
+/* index of the next element to draw in pre-order, stepping over culled subtrees */
+static int next_drawn(mu_Elem *elem) {
+  return (elem->cull & MU_CULL_CHILDREN) ? elem->tree.end : elem->idx + 1;
+}
+
+static void position_subtree(mu_Context *ctx, mu_Elem *elem) {
+  place_children(ctx, elem, content_clip(elem));
+  for (int i = 0; i < elem->tree.count; i++) {
+    position_subtree(ctx, &ctx->element_stack.items[elem->tree.children[i]]);
+  }
+}
+
+/* Splits the children of elem into layout jobs. `own` has already been run on
+ * elem. Subtrees holding a large share of all elements are opened up so their
+ * own children can run in parallel; subtrees below the threshold are batched. */
+static void collect_layout_jobs(mu_Context *ctx, LayoutJobs *d, mu_Elem *elem,
+                                void (*own)(mu_Context *ctx, mu_Elem *elem)) {
+  int total = ctx->element_stack.idx;
+  for (int i = 0; i < elem->tree.count; i++) {
+    mu_Elem *child = &ctx->element_stack.items[elem->tree.children[i]];
+    int size = child->tree.end - child->idx;
+    if (size > total / 4 && child->tree.count > 1) {
+      own(ctx, child);
+      collect_layout_jobs(ctx, d, child, own);
+    } else if (size >= ctx->parallel_threshold) {
+      d->jobs[d->njobs++] = child->idx;
+    } else {
+      d->inline_jobs[d->ninline++] = child->idx;
+    }
+  }
+}
+
+static void resize_own(mu_Context *ctx, mu_Elem *elem) {
+  mu_resize_children(ctx, elem);
+}
+
+static void place_own(mu_Context *ctx, mu_Elem *elem) {
+  place_children(ctx, elem, content_clip(elem));
+}
+
+static void resize_job(void *data, int index) {
+  LayoutJobs *d = data;
+  if (index == d->njobs) {
+    for (int i = 0; i < d->ninline; i++) { resize_subtree(d->ctx, &d->ctx->element_stack.items[d->inline_jobs[i]]); }
+  } else {
+    resize_subtree(d->ctx, &d->ctx->element_stack.items[d->jobs[index]]);
+  }
+}
+
+static void position_job(void *data, int index) {
+  LayoutJobs *d = data;
+  if (index == d->njobs) {
+    for (int i = 0; i < d->ninline; i++) { position_subtree(d->ctx, &d->ctx->element_stack.items[d->inline_jobs[i]]); }
+  } else {
+    position_subtree(d->ctx, &d->ctx->element_stack.items[d->jobs[index]]);
+  }
+}
+
+/// @brief Runs a layout pass over all elements, in parallel when possible.
+/// @param ctx The MicroUI context.
+/// @param own The per-element step, applied parent before children.
+/// @param job The task running the step over whole subtrees.
+///
+/// Once an element has been processed its child subtrees are independent, so
+/// they are spread over `ctx->parallel_for`. Every element still goes through
+/// the exact same arithmetic as in the serial pass, so the result is
+/// bit-identical.
+static void run_layout_pass(mu_Context *ctx, void (*own)(mu_Context *ctx, mu_Elem *elem),
+                            mu_TaskFunc job) {
+  LayoutJobs d;
+  mu_Elem *root = &ctx->element_stack.items[0];
+  d.ctx = ctx;
+  d.njobs = 0;
+  d.ninline = 0;
+  own(ctx, root);
+  collect_layout_jobs(ctx, &d, root, own);
+  if (d.njobs == 0) {
+    job(&d, 0);
+  } else {
+    ctx->parallel_for(job, &d, d.njobs + 1);
+  }
+}
+
 void mu_resize(mu_Context *ctx) {
+  if (ctx->element_stack.idx == 0) { return; }
+  if (ctx->parallel_for) {
+    run_layout_pass(ctx, resize_own, resize_job);
+    return;
+  }
   for (int i = 0; i < ctx->element_stack.idx; i++)
   {
     mu_resize_children(ctx, &ctx->element_stack.items[i]);
@@ -959,8 +1512,22 @@ void mu_apply_size(mu_Context *ctx)
   }
 }
 
-void mu_adjust_children_positions(mu_Context *ctx,mu_Elem* elem){
-  mu_push_clip_rect(ctx,elem->rect);
+/* scroll of an element's content; an animated vertical scroll takes precedence */
+static mu_Vec2 elem_scroll(mu_Elem *elem) {
+  mu_Vec2 scroll = elem->style.scroll;
+  if (elem->anim_override->set_flags & MU_STYLE_SCROLL_Y) { scroll.y = elem->anim_override->scroll.y; }
+  return scroll;
+}
+
+/// @brief Positions the direct children of an element.
+/// @param ctx The MicroUI context.
+/// @param elem The parent element, already positioned.
+/// @param clip The rectangle the children are clipped to.
+///
+/// Only touches the children, which makes sibling subtrees independent.
+/// Children are placed without the parent's scroll; it only goes into their
+/// offset, so scrolling leaves every rect below the container unchanged.
+static void place_children(mu_Context *ctx, mu_Elem *elem, mu_Rect clip){
   if (elem->tree.count>0){
     mu_fVec2 m;
     if (elem->childAlignment & MU_ALIGN_LEFT)   m.x = 0.0f;
@@ -970,6 +1537,7 @@ void mu_adjust_children_positions(mu_Context *ctx,mu_Elem* elem){
     if (elem->childAlignment & MU_ALIGN_MIDDLE) m.y = 0.5f;
     if (elem->childAlignment & MU_ALIGN_BOTTOM) m.y = 1.0f;
     mu_Elem* child;
+    mu_Vec2 scroll = elem_scroll(elem);
     int compoundx=0;
     int compoundy=0;
     for (int i = 0; i < elem->tree.count; i++)  {
@@ -993,37 +1561,232 @@ void mu_adjust_children_positions(mu_Context *ctx,mu_Elem* elem){
       }
       child->rect.x += compoundx;
       child->rect.y += compoundy;
-      child->rect.x += elem->style.scroll.x;
-      if (elem->anim_override->set_flags & MU_STYLE_SCROLL_Y) {
-        child->rect.y += elem->anim_override->scroll.y;
-      } else {
-        child->rect.y += elem->style.scroll.y;
-
-      } 
+      child->offset = mu_vec2(elem->offset.x + scroll.x, elem->offset.y + scroll.y);
       compoundx     += (child->rect.w +elem->style.gap)*((elem->direction +0)%2);
       compoundy     += (child->rect.h +elem->style.gap)*((elem->direction +1)%2);
 
-      child->clip=mu_get_clip_rect(ctx);
+      child->clip=clip;
+    }
+  }
+}
 
-      if (child->settings&(MU_EL_CLICKABLE|MU_EL_DRAGGABLE|MU_EL_STUTTER)){
-        mu_update_element_control(ctx,child);
+static mu_PointerState pointer_state(mu_Context *ctx) {
+  mu_PointerState p;
+  memset(&p, 0, sizeof(p)); /* compared with memcmp */
+  p.mouse_pos = ctx->mouse_pos;
+  p.finger_pos = ctx->finger_pos;
+  p.mouse_down = ctx->mouse_down;
+  p.mouse_pressed = ctx->mouse_pressed;
+  p.finger_down = ctx->finger_down;
+  p.finger_pressed = ctx->finger_pressed;
+  p.focus = ctx->focus;
+  p.hover = ctx->hover;
+  return p;
+}
+
+static int grid_cell(int v, int origin, int size) {
+  return mu_clamp((v - origin) / size, 0, MU_HITGRID_SIZE - 1);
+}
+
+/* returns 0 when the clipped rects do not fit into the grid */
+static int build_hit_grid(mu_Context *ctx, mu_HitGrid *g, const int *elems, int count) {
+  int cursor[MU_HITGRID_SIZE * MU_HITGRID_SIZE];
+  mu_Rect r[MU_ELEMENTSTACK_SIZE];
+  int x1 = 0x1000000, y1 = 0x1000000, x2 = -0x1000000, y2 = -0x1000000;
+  for (int i = 0; i < count; i++) {
+    mu_Elem *elem = &ctx->element_stack.items[elems[i]];
+    r[i] = intersect_rects(mu_screen_rect(elem), elem->clip);
+    if (r[i].w <= 0 || r[i].h <= 0) { continue; }
+    x1 = mu_min(x1, r[i].x); y1 = mu_min(y1, r[i].y);
+    x2 = mu_max(x2, r[i].x + r[i].w); y2 = mu_max(y2, r[i].y + r[i].h);
+  }
+  memset(g->start, 0, sizeof(g->start));
+  if (x2 <= x1) { return 1; } /* nothing can be hit */
+  g->bounds = mu_rect(x1, y1, x2 - x1, y2 - y1);
+  g->cell_w = (g->bounds.w + MU_HITGRID_SIZE - 1) / MU_HITGRID_SIZE;
+  g->cell_h = (g->bounds.h + MU_HITGRID_SIZE - 1) / MU_HITGRID_SIZE;
+
+  /* counting sort, so every cell lists its elements in pre-order */
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < count; i++) {
+      if (r[i].w <= 0 || r[i].h <= 0) { continue; }
+      int cx0 = grid_cell(r[i].x, x1, g->cell_w), cx1 = grid_cell(r[i].x + r[i].w - 1, x1, g->cell_w);
+      int cy0 = grid_cell(r[i].y, y1, g->cell_h), cy1 = grid_cell(r[i].y + r[i].h - 1, y1, g->cell_h);
+      for (int cy = cy0; cy <= cy1; cy++) {
+        for (int cx = cx0; cx <= cx1; cx++) {
+          int c = cy * MU_HITGRID_SIZE + cx;
+          if (pass == 0) { g->start[c + 1]++; } else { g->items[cursor[c]++] = (short)elems[i]; }
+        }
       }
-      mu_adjust_children_positions(ctx,child);
+    }
+    if (pass == 0) {
+      for (int c = 0; c < MU_HITGRID_SIZE * MU_HITGRID_SIZE; c++) {
+        g->start[c + 1] += g->start[c];
+        cursor[c] = g->start[c];
+      }
+      if (g->start[MU_HITGRID_SIZE * MU_HITGRID_SIZE] > MU_HITGRID_ENTRIES) { return 0; }
+    }
+  }
+  return 1;
+}
+
+/* inserts v into the sorted list out of length n, returns the new length */
+static int insert_unique(int *out, int n, int v) {
+  int i = n;
+  while (i > 0 && out[i - 1] > v) { i--; }
+  if (i > 0 && out[i - 1] == v) { return n; }
+  memmove(&out[i + 1], &out[i], (n - i) * sizeof(int));
+  out[i] = v;
+  return n + 1;
+}
+
+/* adds the elements under p to the sorted list out */
+static int query_hit_grid(mu_Context *ctx, mu_HitGrid *g, mu_Vec2 p, int *out, int n) {
+  if (!rect_overlaps_vec2(g->bounds, p)) { return n; }
+  int c = grid_cell(p.y, g->bounds.y, g->cell_h) * MU_HITGRID_SIZE + grid_cell(p.x, g->bounds.x, g->cell_w);
+  for (int k = g->start[c]; k < g->start[c + 1]; k++) {
+    mu_Elem *elem = &ctx->element_stack.items[g->items[k]];
+    if (rect_overlaps_vec2(elem->rect, mu_vec2(p.x - elem->offset.x, p.y - elem->offset.y)) && rect_overlaps_vec2(elem->clip, p)) {
+      n = insert_unique(out, n, elem->idx);
+    }
+  }
+  return n;
+}
 
-      
+/// @brief Resolves hover, focus and element states after layout.
+/// @param ctx The MicroUI context.
+///
+/// A control that is neither under the mouse or finger nor the current hover
+/// or focus target always ends up MU_STATE_ACTIVE without side effects, so only
+/// the few controls found through the hit grid get the full update, in
+/// pre-order. When the interactive layout and the pointer state match the last
+/// update and that update left hover and focus unchanged, running it again
+/// would reproduce the same states, so the frame is skipped. This relies on
+/// element ids being unique.
+static void update_controls(mu_Context *ctx) {
+  mu_HitGrid *g = &ctx->hit_grid;
+  int elems[MU_ELEMENTSTACK_SIZE], count = 0;
+  int cand[MU_ELEMENTSTACK_SIZE + 2], ncand = 0;
+  int targets[2], ntargets = 0;
+  mu_Id sig = HASH_INITIAL;
+  mu_PointerState input = pointer_state(ctx);
+
+  for (int i = 1; i < ctx->element_stack.idx; i++) {
+    mu_Elem *elem = &ctx->element_stack.items[i];
+    if (elem->settings&(MU_EL_CLICKABLE|MU_EL_DRAGGABLE|MU_EL_STUTTER)){
+      hash(&sig, &elem->idx, sizeof(elem->idx));
+      hash(&sig, &elem->hash, sizeof(elem->hash));
+      hash(&sig, &elem->rect, sizeof(elem->rect));
+      hash(&sig, &elem->offset, sizeof(elem->offset));
+      hash(&sig, &elem->clip, sizeof(elem->clip));
+      if ((elem->hash == ctx->focus || elem->hash == ctx->hover) && ntargets < 2) { targets[ntargets++] = i; }
+      elems[count++] = i;
     }
   }
-  mu_pop_clip_rect(ctx);
+  if (g->settled && sig == g->signature && memcmp(&input, &g->input, sizeof(input)) == 0) { return; }
+  g->signature = sig;
+  g->input = input;
+
+  if (!build_hit_grid(ctx, g, elems, count)) {
+    /* too many overlapping rects for the grid, update everything */
+    for (int i = 0; i < count; i++) { mu_update_element_control(ctx, &ctx->element_stack.items[elems[i]]); }
+  } else {
+    ncand = query_hit_grid(ctx, g, ctx->mouse_pos, cand, ncand);
+    ncand = query_hit_grid(ctx, g, ctx->finger_pos, cand, ncand);
+    for (int t = 0; t < ntargets; t++) { ncand = insert_unique(cand, ncand, targets[t]); }
+    for (int i = 0; i < count; i++) { ctx->element_stack.items[elems[i]].state = MU_STATE_ACTIVE; }
+    for (int i = 0; i < ncand; i++) { mu_update_element_control(ctx, &ctx->element_stack.items[cand[i]]); }
+  }
+  g->settled = ctx->focus == input.focus && ctx->hover == input.hover;
 }
 
+static mu_Id style_hash(const mu_Style *style) {
+  mu_Id h = HASH_INITIAL;
+  hash(&h, style, sizeof(*style));
+  return h;
+}
+
+static mu_Id text_hash(const char *str) {
+  mu_Id h = HASH_INITIAL;
+  if (str) { hash(&h, str, strlen(str)); }
+  return h;
+}
 
+static void push_diff(mu_Context *ctx, mu_Id id, int idx, int flags, mu_Rect rect, mu_Rect prev_rect) {
+  mu_Diff d;
+  d.id = id; d.idx = idx; d.flags = flags; d.rect = rect; d.prev_rect = prev_rect;
+  push(ctx->diff, d);
+}
+
+/// @brief Stores the finished layout in the retained state and diffs it.
+/// @param ctx The MicroUI context.
+///
+/// Walks the element stack once in pre-order, comparing every element with
+/// what its id looked like in the previous layout. Afterwards the ids of the
+/// previous layout that were not laid out again are reported as removed.
+/// Elements that did not change produce no entry.
+static void retain_layout(mu_Context *ctx) {
+  int prev = ctx->last_layout_frame;
+  ctx->diff.idx = 0;
+  for (int i = 0; i < ctx->element_stack.idx; i++) {
+    mu_Elem *elem = &ctx->element_stack.items[i];
+    mu_ElemState *st = elem->retained;
+    mu_Id parent = (elem->tree.parent >= 0) ? ctx->element_stack.items[elem->tree.parent].hash : 0;
+    mu_Id sh = style_hash(&elem->style), th = text_hash(elem->text.str);
+    int flags = 0;
+    if (!prev || st->laid_out != prev) {
+      flags = MU_DIFF_ADDED;
+    } else {
+      if (st->rect.x != elem->rect.x || st->rect.y != elem->rect.y || st->parent != parent) { flags |= MU_DIFF_MOVED; }
+      if (st->rect.w != elem->rect.w || st->rect.h != elem->rect.h) { flags |= MU_DIFF_RESIZED; }
+      if (st->style_hash != sh) { flags |= MU_DIFF_RESTYLED; }
+      if (st->text_hash != th) { flags |= MU_DIFF_RETEXTED; }
+    }
+    if (flags) { push_diff(ctx, elem->hash, i, flags, elem->rect, st->rect); }
+    st->state = elem->state;
+    st->cooldown = elem->cooldown;
+    st->rect = elem->rect;
+    st->laid_out = ctx->frame;
+    st->parent = parent;
+    st->style_hash = sh;
+    st->text_hash = th;
+  }
+  for (int i = 0; i < ctx->prev_ids.idx; i++) {
+    mu_ElemState *st = mu_find_state(ctx, ctx->prev_ids.items[i]);
+    if (!st || st->laid_out != ctx->frame) {
+      mu_Rect r = st ? st->rect : mu_rect(0, 0, 0, 0);
+      push_diff(ctx, ctx->prev_ids.items[i], -1, MU_DIFF_REMOVED, r, r);
+    }
+  }
+  for (int i = 0; i < ctx->element_stack.idx; i++) {
+    ctx->prev_ids.items[i] = ctx->element_stack.items[i].hash;
+  }
+  ctx->prev_ids.idx = ctx->element_stack.idx;
+  ctx->last_layout_frame = ctx->frame;
+}
+
+/// @brief Iterates over the changes between the last two layouts.
+/// @param ctx The MicroUI context.
+/// @param diff In/out cursor; start with NULL.
+/// @return Returns 1 if an entry was found, or 0 at the end of the diff.
+///
+/// Valid after mu_adjust_elem_positions until the next layout. Entries of the
+/// current elements come first in pre-order, followed by removed elements.
+int mu_next_diff(mu_Context *ctx, mu_Diff **diff) {
+  *diff = *diff ? *diff + 1 : ctx->diff.items;
+  return *diff < ctx->diff.items + ctx->diff.idx;
+}
 
 void mu_adjust_elem_positions(mu_Context *ctx)
 {
-  mu_push_unclipped(ctx);
-  mu_adjust_children_positions(ctx,&ctx->element_stack.items[0]);
-  mu_pop_clip_rect(ctx);
-
+  if (ctx->element_stack.idx == 0) { return; }
+  if (ctx->parallel_for) {
+    run_layout_pass(ctx, place_own, position_job);
+  } else {
+    position_subtree(ctx, &ctx->element_stack.items[0]);
+  }
+  update_controls(ctx);
+  retain_layout(ctx);
 }
 
 static inline float lerp_float(float a, float b, float t) {
@@ -1055,7 +1818,8 @@ static inline mu_Color lerp_color(mu_Color a, mu_Color b, float t) {
     /* font and text_align don’t really lerp meaningfully */ \
     X(MU_STYLE_HOVER_COLOR,  hover_color, lerp_color) \
     X(MU_STYLE_SCROLL_X,     scroll.x,    lerp_float) \
-    X(MU_STYLE_SCROLL_Y,     scroll.y,    lerp_float)
+    X(MU_STYLE_SCROLL_Y,     scroll.y,    lerp_float) \
+    X(MU_STYLE_RADIUS,       radius,      lerp_char)
 
 mu_StyleOverride mu_interp_style(mu_StyleOverride initial,
                                            mu_StyleOverride target,
@@ -1084,7 +1848,8 @@ mu_StyleOverride mu_interp_style(mu_StyleOverride initial,
     APPLY_FIELD(MU_STYLE_HOVER_COLOR,  hover_color) \
     /* focus_color not in override flags? If needed, add here */ \
     APPLY_FIELD(MU_STYLE_SCROLL_X,     scroll.x) \
-    APPLY_FIELD(MU_STYLE_SCROLL_Y,     scroll.y)
+    APPLY_FIELD(MU_STYLE_SCROLL_Y,     scroll.y) \
+    APPLY_FIELD(MU_STYLE_RADIUS,       radius)
 
 void mu_apply_override(mu_Style *dst, const mu_StyleOverride *ovr) {
     #define APPLY_FIELD(FLAG, FIELD) \
@@ -1096,33 +1861,26 @@ void mu_apply_override(mu_Style *dst, const mu_StyleOverride *ovr) {
 }
 
 void mu_apply(mu_Context *ctx, mu_Elem* elem) {
- for (int i = 0; i < ctx->anim_stack.idx; i++) 
-  {
-    mu_Anim* it =&ctx->anim_stack.items[i];
-    if (it->hash==elem->hash){
-      elem->anim_override->scroll.y+=1;
-      elem->anim_override->set_flags|=MU_STYLE_SCROLL_Y;
-    }
+  unused(ctx);
+  if (elem->retained->anim >= 0) {
+    elem->anim_override->scroll.y+=1;
+    elem->anim_override->set_flags|=MU_STYLE_SCROLL_Y;
   }
 }
 mu_StyleOverride mu_apply_animation(mu_Context *ctx, mu_Elem* elem){
-  
-  for (int i = 0; i < ctx->anim_stack.idx; i++) 
-  {
-    mu_Anim* it =&ctx->anim_stack.items[i];
-    if (it->hash==elem->hash){
-      //TODO CHANGE INITIAL TO USE
-      if (it->progress==0){
-        it->initial=*elem->anim_override;
-        it->prev=it->initial;
-      }
-      double p = it->progress;
-      p = 1 - (1-p) * (1-p); // this is a east out quad tween. we can also use different tweens
-      it->prev=mu_interp_style(it->initial,it->animable,p);
-      // printf("received scroll val of  %d\n", it->animable.scroll.y);
-      return it->prev;
-
+  /* an id has at most one animation, found through its retained state */
+  if (elem->retained->anim >= 0) {
+    mu_Anim* it =&ctx->anim_stack.items[elem->retained->anim];
+    //TODO CHANGE INITIAL TO USE
+    if (it->progress==0){
+      it->initial=*elem->anim_override;
+      it->prev=it->initial;
     }
+    double p = it->progress;
+    p = 1 - (1-p) * (1-p); // this is a east out quad tween. we can also use different tweens
+    it->prev=mu_interp_style(it->initial,it->animable,p);
+    // printf("received scroll val of  %d\n", it->animable.scroll.y);
+    return it->prev;
   }
   
   return (mu_StyleOverride){};
@@ -1134,53 +1892,691 @@ void print_binary(unsigned int n) {
     }
 }
 
-void mu_draw_debug_elems(mu_Context *ctx){
+static void apply_animations(mu_Context *ctx) {
   for (int i = 0; i < ctx->element_stack.idx; i++)
   {
     mu_Elem*elem=&ctx->element_stack.items[i];
-    
-    // mu_apply(ctx, elem);
-    // elem->anim_override=mu_apply_animation(ctx,elem);
-    
     mu_StyleOverride buff= mu_apply_animation(ctx,elem);
     if (buff.set_flags){
       memcpy(elem->anim_override,&buff,sizeof(mu_StyleOverride));
     }
-    
+  }
+}
+
+static int is_layer(mu_Elem *elem) {
+  return (elem->settings & MU_EL_LAYER) && elem->idx != 0;
+}
+
+/* content_clip for drawing, which starts over below a layer */
+static mu_Rect drawn_content_clip(mu_Elem *elem) {
+  return intersect_rects(mu_screen_rect(elem), elem->idx == 0 ? unclipped_rect : elem->draw_clip);
+}
 
-    mu_draw_debug_clip_outline_ex(ctx, elem->rect, elem->clip,elem->style.border_color, elem->style.border_size);
-    if (elem->settings&MU_EL_DEBUG){
-      mu_draw_rect(ctx,elem->clip,mu_color(0,0,255,50));
-      mu_draw_rect(ctx,intersect_rects(elem->clip,elem->rect),mu_color(0,255,0,50));
+/// @brief Marks the elements whose draw commands would be fully clipped.
+/// @param ctx The MicroUI context.
+///
+/// Each element is tested once against its inherited clip. When the clip
+/// handed to its children is empty, every descendant is clipped away as well,
+/// so the subtree is skipped without being visited. Readers of `elem->cull`
+/// must walk the stack with `next_drawn` since skipped elements keep stale flags.
+///
+/// Also sets `draw_clip`. It equals `clip` except within a layer, whose
+/// subtree is drawn clipped to the layer alone so the cached pixels stay
+/// valid while the layer moves; the renderer clips the composited layer.
+static void cull_elems(mu_Context *ctx) {
+  for (int i = 0; i < ctx->element_stack.idx; ) {
+    mu_Elem *elem = &ctx->element_stack.items[i];
+    mu_Rect rect = mu_screen_rect(elem);
+    int t = elem->style.border_size;
+    mu_Rect outline = mu_rect(rect.x - t, rect.y - t, rect.w + 2 * t, rect.h + 2 * t);
+    if (i == 0) {
+      elem->draw_clip = elem->clip;
+    } else {
+      elem->draw_clip = is_layer(elem) ? outline : drawn_content_clip(&ctx->element_stack.items[elem->tree.parent]);
     }
-    
-    if (elem->text.str) {
-      mu_draw_text_ex(ctx,elem->style.font,elem->text.str,strlen(elem->text.str),mu_vec2(elem->rect.x,elem->rect.y),elem->style.text_color,intersect_rects(elem->clip,elem->rect),elem->rect,elem->style.text_align,elem->style.padding );
+    elem->cull = 0;
+    if (is_layer(elem) && rect_empty(intersect_rects(outline, elem->clip))) {
+      elem->cull = MU_CULL_SELF | MU_CULL_TEXT | MU_CULL_CHILDREN;
+    } else if (rect_empty(intersect_rects(rect, elem->draw_clip))) {
+      elem->cull |= MU_CULL_TEXT;
+      /* the debug overlay paints the clip itself, so it is never culled */
+      if (!(elem->settings & MU_EL_DEBUG) && rect_empty(intersect_rects(outline, elem->draw_clip))) {
+        elem->cull |= MU_CULL_SELF;
+      }
+    }
+    if (rect_empty(drawn_content_clip(elem))) { elem->cull |= MU_CULL_CHILDREN; }
+    i = next_drawn(elem);
+  }
+}
+
+/* upper bound of the bytes draw_elem can emit, used to size worker segments */
+static int elem_command_bound(mu_Elem *elem) {
+  int n;
+  if (elem->cull & MU_CULL_SELF) { return 0; }
+  n = 3 * command_size(mu_ClipCommand) + command_size(mu_BoxCommand) + 2 * command_size(mu_RectCommand) + command_size(mu_TranslateCommand);
+  if (elem->image) { n += command_size(mu_ClipCommand) + command_size(mu_ImageCommand); }
+  if (is_layer(elem)) { n += 2 * command_size(mu_ClipCommand) + command_size(mu_LayerCommand) + command_size(mu_BaseCommand) + command_size(mu_TranslateCommand); }
+  if (elem->text.str && !(elem->cull & MU_CULL_TEXT)) {
+    n += command_size(mu_ClipCommand) + command_size(mu_TextCommand);
+    if (!(elem->settings & MU_EL_STATIC_TEXT)) { n += strlen(elem->text.str) + 1; }
+  }
+  return n;
+}
+
+/* commands are written in the element's local space, see draw_range */
+static void draw_elem(mu_Context *ctx, mu_CommandSegment *seg, mu_Elem *elem) {
+  mu_Rect clip = translate_rect(elem->draw_clip, mu_vec2(-elem->offset.x, -elem->offset.y));
+  int t = elem->style.border_size;
+  if (elem->cull & MU_CULL_SELF) { return; }
+  /* elements paint no background, only the border around their rect */
+  if (t > 0) {
+    mu_Rect outline = mu_rect(elem->rect.x - t, elem->rect.y - t, elem->rect.w + 2 * t, elem->rect.h + 2 * t);
+    segment_box(seg, outline, clip, mu_color(0, 0, 0, 0), elem->style.border_color, t, elem->style.radius);
+  }
+  if (elem->settings&MU_EL_DEBUG){
+    mu_draw_debug_clip_rect(seg,clip,reset_clip,mu_color(0,0,255,50));
+    mu_draw_debug_clip_rect(seg,intersect_rects(clip,elem->rect),reset_clip,mu_color(0,255,0,50));
+  }
+  if (elem->image) {
+    segment_image(seg, elem->image, elem->rect, clip, mu_color(255, 255, 255, 255));
+  }
+
+  if (elem->text.str && !(elem->cull & MU_CULL_TEXT)) {
+    mu_draw_text_ex(ctx,seg,elem->style.font,elem->text.str,strlen(elem->text.str),!(elem->settings & MU_EL_STATIC_TEXT),mu_vec2(elem->rect.x,elem->rect.y),elem->style.text_color,intersect_rects(clip,elem->rect),elem->rect,elem->style.text_align,elem->style.padding );
+  }
+}
+
+typedef struct {
+  mu_Context *ctx;
+  mu_CommandSegment seg[MU_ELEMENTSTACK_SIZE];
+  int start[MU_ELEMENTSTACK_SIZE], end[MU_ELEMENTSTACK_SIZE];
+  char *ret[MU_ELEMENTSTACK_SIZE]; // where the segment jumps back to
+  mu_SegmentRef *ref[MU_ELEMENTSTACK_SIZE];
+  int count;
+  int jobs[MU_ELEMENTSTACK_SIZE];
+  mu_Id version[MU_ELEMENTSTACK_SIZE];
+  mu_SegmentArena *arena;
+  int slot;
+  int saved; // pixels the occlusion pass removed from the segments linked in
+} DrawJobs;
+
+/* opens a layer, the translation has to be at the element's offset */
+static mu_Command *segment_begin_layer(mu_CommandSegment *seg, mu_Elem *elem, mu_Id version) {
+  mu_Command *cmd;
+  int t = elem->style.border_size;
+  segment_unclip(seg);
+  cmd = push_segment_command(seg, MU_COMMAND_LAYER, sizeof(mu_LayerCommand));
+  cmd->layer.id = elem->hash;
+  cmd->layer.version = version;
+  cmd->layer.rect = mu_rect(elem->rect.x - t, elem->rect.y - t, elem->rect.w + 2 * t, elem->rect.h + 2 * t);
+  cmd->layer.clip = translate_rect(elem->clip, mu_vec2(-elem->offset.x, -elem->offset.y));
+  cmd->layer.end = NULL;
+  return cmd;
+}
+
+static void segment_end_layer(mu_CommandSegment *seg, mu_Command *begin) {
+  segment_unclip(seg);
+  begin->layer.end = push_segment_command(seg, MU_COMMAND_LAYER_END, sizeof(mu_BaseCommand));
+}
+
+/* entered and left with the translation at the offset of the first element;
+ * layers below the first element are opened and closed in here */
+static void draw_range(DrawJobs *d, mu_CommandSegment *seg, int start, int end) {
+  mu_Elem *items = d->ctx->element_stack.items;
+  mu_Command *open[MU_LAYERSTACK_SIZE];
+  int layer[MU_LAYERSTACK_SIZE], depth = 0;
+  mu_Vec2 at = items[start].offset;
+  for (int i = start; i < end; i = next_drawn(&items[i])) {
+    mu_Elem *elem = &items[i];
+    while (depth > 0 && items[layer[depth - 1]].tree.end <= i) {
+      depth--;
+      segment_translate(seg, &at, items[layer[depth]].offset);
+      segment_end_layer(seg, open[depth]);
+    }
+    if (!(elem->cull & MU_CULL_SELF)) { segment_translate(seg, &at, elem->offset); }
+    if (i != start && is_layer(elem) && !(elem->cull & MU_CULL_SELF)) {
+      expect(depth < MU_LAYERSTACK_SIZE);
+      layer[depth] = i;
+      open[depth++] = segment_begin_layer(seg, elem, d->version[i]);
+    }
+    draw_elem(d->ctx, seg, elem);
+  }
+  while (depth > 0) {
+    depth--;
+    segment_translate(seg, &at, items[layer[depth]].offset);
+    segment_end_layer(seg, open[depth]);
+  }
+  segment_translate(seg, &at, items[start].offset);
+}
+
+/* the draws of one run between barriers, see `batch_clips` */
+typedef struct {
+  mu_Command *cmd[MU_CLIPBATCH_SIZE];
+  int group[MU_CLIPBATCH_SIZE];
+  mu_Rect clip[MU_CLIPBATCH_SIZE], area[MU_CLIPBATCH_SIZE]; // per group: clip and visible bounds
+  int count, groups;
+  int clips; // clip commands in the run
+  char *start; // first command of the run
+  mu_Rect enter; // clip before the run
+} ClipBatch;
+
+static int same_clip(mu_Rect a, mu_Rect b) {
+  return !memcmp(&a, &b, sizeof(a));
+}
+
+/* bounds of what a draw command can touch, 0 for anything else */
+static int command_bounds(mu_Context *ctx, mu_Command *cmd, mu_Rect *r) {
+  switch (cmd->type) {
+    case MU_COMMAND_RECT: *r = cmd->rect.rect; return 1;
+    case MU_COMMAND_BOX:  *r = cmd->box.rect; return 1;
+    case MU_COMMAND_ICON: *r = cmd->icon.rect; return 1;
+    case MU_COMMAND_IMAGE: *r = cmd->image.rect; return 1;
+    case MU_COMMAND_TEXT:
+      *r = mu_rect(cmd->text.pos.x, cmd->text.pos.y, cmd->text.width, ctx->text_height(cmd->text.font));
+      return 1;
+  }
+  return 0;
+}
+
+/* joins the last group drawn under the same clip, unless a group after that
+ * one overlaps the draw; painter's order only changes between draws that do
+ * not overlap */
+static void batch_add(ClipBatch *b, mu_Command *cmd, mu_Rect clip, mu_Rect bounds) {
+  mu_Rect vis = intersect_rects(bounds, clip);
+  int g;
+  for (g = b->groups - 1; g >= 0; g--) {
+    if (same_clip(b->clip[g], clip)) { break; }
+    if (!rect_empty(intersect_rects(b->area[g], vis))) { g = -1; break; }
+  }
+  if (g < 0) {
+    g = b->groups++;
+    b->clip[g] = clip;
+    b->area[g] = vis;
+  } else if (rect_empty(b->area[g])) {
+    b->area[g] = vis;
+  } else if (!rect_empty(vis)) {
+    mu_Rect a = b->area[g];
+    int x1 = mu_min(a.x, vis.x), y1 = mu_min(a.y, vis.y);
+    int x2 = mu_max(a.x + a.w, vis.x + vis.w), y2 = mu_max(a.y + a.h, vis.y + vis.h);
+    b->area[g] = mu_rect(x1, y1, x2 - x1, y2 - y1);
+  }
+  b->cmd[b->count] = cmd;
+  b->group[b->count++] = g;
+}
+
+/* rewrites the run in place, group after group, when that takes fewer clip
+ * commands; the run ends before `end` and leaves the renderer at `exit`. A
+ * jump skips the bytes the dropped clip commands leave free */
+static void batch_flush(ClipBatch *b, char *end, mu_Rect exit) {
+  union { mu_Command cmd; char bytes[sizeof(mu_Command) + MU_COMMAND_ALIGN]; } saved[MU_CLIPBATCH_SIZE];
+  mu_Rect at = b->enter;
+  char *p = b->start;
+  int clips = 0;
+  for (int g = 0; g < b->groups; g++) {
+    if (!same_clip(b->clip[g], at)) { clips++; at = b->clip[g]; }
+  }
+  if (!same_clip(at, exit)) { clips++; }
+  if (clips < b->clips) {
+    for (int i = 0; i < b->count; i++) { memcpy(&saved[i], b->cmd[i], b->cmd[i]->base.size); }
+    at = b->enter;
+    for (int g = 0; g <= b->groups; g++) {
+      mu_Rect clip = g < b->groups ? b->clip[g] : exit;
+      if (!same_clip(clip, at)) {
+        mu_Command *cmd = (mu_Command*) p;
+        cmd->base.type = MU_COMMAND_CLIP;
+        cmd->base.size = command_size(mu_ClipCommand);
+        cmd->clip.rect = at = clip;
+        p += cmd->base.size;
+      }
+      for (int i = 0; g < b->groups && i < b->count; i++) {
+        if (b->group[i] != g) { continue; }
+        memcpy(p, &saved[i], saved[i].cmd.base.size);
+        p += saved[i].cmd.base.size;
+      }
+    }
+    if (p < end) {
+      mu_Command *cmd = (mu_Command*) p;
+      cmd->base.type = MU_COMMAND_JUMP;
+      cmd->base.size = end - p;
+      cmd->jump.dst = end;
     }
   }
+  b->count = b->groups = b->clips = 0;
 }
 
+/// @brief Reorders the draws of a segment so draws under one clip are adjacent.
+/// @param ctx The MicroUI context.
+/// @param seg A finished segment, left unclipped.
+///
+/// Translations, jumps and layers split the segment into runs; a run is
+/// regrouped by the clip each draw was made under, see `batch_add`. Only runs
+/// that end up with fewer clip changes are rewritten, so the segment never
+/// grows. Enabled by `ctx->clip_batching`.
+static void batch_clips(mu_Context *ctx, mu_CommandSegment *seg) {
+  ClipBatch b;
+  mu_Rect clip = reset_clip;
+  char *p = seg->base, *end = seg->base + seg->idx;
+  b.count = b.groups = b.clips = 0;
+  b.start = p;
+  b.enter = clip;
+  while (p < end) {
+    mu_Command *cmd = (mu_Command*) p;
+    mu_Rect bounds;
+    if (cmd->type == MU_COMMAND_CLIP) {
+      clip = cmd->clip.rect;
+      b.clips++;
+    } else if (command_bounds(ctx, cmd, &bounds)) {
+      if (b.count == MU_CLIPBATCH_SIZE) {
+        batch_flush(&b, p, clip);
+        b.start = p;
+        b.enter = clip;
+      }
+      batch_add(&b, cmd, clip, bounds);
+    } else {
+      batch_flush(&b, p, clip);
+      if (cmd->type == MU_COMMAND_TRANSLATE && !same_clip(clip, reset_clip)) {
+        clip = translate_rect(clip, mu_vec2(-cmd->translate.offset.x, -cmd->translate.offset.y));
+      }
+      b.start = p + cmd->base.size;
+      b.enter = clip;
+    }
+    p += cmd->base.size;
+  }
+  batch_flush(&b, end, clip);
+}
 
+/* the part of a draw that covers what is below it completely, empty if none */
+static mu_Rect opaque_area(mu_Command *cmd) {
+  if (cmd->type == MU_COMMAND_RECT && cmd->rect.color.a == 255) { return cmd->rect.rect; }
+  if (cmd->type == MU_COMMAND_BOX && cmd->box.color.a == 255) {
+    mu_BoxCommand *b = &cmd->box;
+    /* staying clear of the corners by the radius keeps it a rect */
+    int inset = (b->border > 0 && b->border_color.a < 255) ? mu_max(b->border, b->radius) : b->radius;
+    return mu_rect(b->rect.x + inset, b->rect.y + inset, b->rect.w - 2 * inset, b->rect.h - 2 * inset);
+  }
+  return mu_rect(0, 0, 0, 0);
+}
 
+static int rect_contains(mu_Rect a, mu_Rect b) {
+  return b.x >= a.x && b.y >= a.y && b.x + b.w <= a.x + a.w && b.y + b.h <= a.y + a.h;
+}
 
+/* cuts the bands an occluder covers across the whole rect off its edges */
+static mu_Rect trim_rect(mu_Rect r, mu_Rect o) {
+  if (o.x <= r.x && o.x + o.w >= r.x + r.w) {
+    int top = r.y, bottom = r.y + r.h;
+    if (o.y <= top && o.y + o.h > top) { top = o.y + o.h; }
+    if (o.y < bottom && o.y + o.h >= bottom) { bottom = o.y; }
+    r = mu_rect(r.x, top, r.w, mu_max(bottom - top, 0));
+  }
+  if (o.y <= r.y && o.y + o.h >= r.y + r.h) {
+    int left = r.x, right = r.x + r.w;
+    if (o.x <= left && o.x + o.w > left) { left = o.x + o.w; }
+    if (o.x < right && o.x + o.w >= right) { right = o.x; }
+    r = mu_rect(left, r.y, mu_max(right - left, 0), r.h);
+  }
+  return r;
+}
+
+/* the draws of one occlusion window, in the space the segment starts in */
+typedef struct {
+  mu_Command *cmd[MU_OCCLUSION_SIZE];
+  mu_Vec2 at[MU_OCCLUSION_SIZE]; // translation the command is drawn at
+  mu_Rect bounds[MU_OCCLUSION_SIZE], clip[MU_OCCLUSION_SIZE];
+  int count;
+} Occlusion;
+
+/* back to front: a draw that later opaque draws hide is dropped, a rect they
+ * hide along a whole edge is trimmed. Returns the pixels no longer drawn */
+static int occlude(Occlusion *o) {
+  mu_Rect occluders[MU_OCCLUDERS];
+  int n = 0, saved = 0;
+  for (int i = o->count - 1; i >= 0; i--) {
+    mu_Command *cmd = o->cmd[i];
+    mu_Rect vis = intersect_rects(translate_rect(o->bounds[i], o->at[i]), o->clip[i]);
+    mu_Rect opaque;
+    int hidden = 0;
+    for (int k = 0; k < n && !hidden; k++) { hidden = rect_contains(occluders[k], vis); }
+    if (cmd->type == MU_COMMAND_RECT && !hidden) {
+      mu_Rect r = translate_rect(cmd->rect.rect, o->at[i]), left;
+      for (int k = 0; k < n; k++) { r = trim_rect(r, occluders[k]); }
+      left = intersect_rects(r, o->clip[i]);
+      hidden = rect_empty(left);
+      if (!hidden) {
+        saved += vis.w * vis.h - left.w * left.h;
+        cmd->rect.rect = translate_rect(r, mu_vec2(-o->at[i].x, -o->at[i].y));
+      }
+    }
+    if (hidden) {
+      /* the command's own bytes become a jump to the next one */
+      int size = cmd->base.size;
+      saved += vis.w * vis.h;
+      cmd->base.type = MU_COMMAND_JUMP;
+      cmd->jump.dst = (char*) cmd + size;
+      continue;
+    }
+    opaque = intersect_rects(translate_rect(opaque_area(cmd), o->at[i]), o->clip[i]);
+    if (!rect_empty(opaque) && n < MU_OCCLUDERS) { occluders[n++] = opaque; }
+  }
+  o->count = 0;
+  return saved;
+}
 
-void mu_animation_update(mu_Context *ctx) { //dt is delta time
-  // printf("animstack size  %d\n", ctx->anim_stack.idx);
-  int dt=ctx->dt;
+/// @brief Removes the overdraw of draws hidden by later opaque draws.
+/// @param ctx The MicroUI context.
+/// @param seg A finished segment, left unclipped.
+/// @return The pixels the segment no longer draws.
+///
+/// Only draws within the segment are compared, so a segment kept in the cache
+/// stays correct wherever it is linked in. Draws in between do not matter, an
+/// opaque draw covers them as well. Layers are compared on their own, as the
+/// renderer may composite them instead. Enabled by `ctx->occlusion`.
+static int occlude_segment(mu_Context *ctx, mu_CommandSegment *seg) {
+  Occlusion o;
+  mu_Vec2 at = mu_vec2(0, 0);
+  mu_Rect clip = reset_clip;
+  char *p = seg->base, *end = seg->base + seg->idx;
+  int saved = 0;
+  o.count = 0;
+  while (p < end) {
+    mu_Command *cmd = (mu_Command*) p;
+    mu_Rect bounds;
+    p += cmd->base.size;
+    switch (cmd->type) {
+      case MU_COMMAND_CLIP:
+        clip = same_clip(cmd->clip.rect, reset_clip) ? reset_clip : translate_rect(cmd->clip.rect, at);
+        break;
+      case MU_COMMAND_TRANSLATE:
+        at = mu_vec2(at.x + cmd->translate.offset.x, at.y + cmd->translate.offset.y);
+        break;
+      case MU_COMMAND_LAYER: case MU_COMMAND_LAYER_END:
+        saved += occlude(&o);
+        break;
+      default:
+        if (!command_bounds(ctx, cmd, &bounds)) { break; }
+        if (o.count == MU_OCCLUSION_SIZE) { saved += occlude(&o); }
+        o.cmd[o.count] = cmd;
+        o.bounds[o.count] = bounds;
+        o.at[o.count] = at;
+        o.clip[o.count++] = clip;
+    }
+  }
+  return saved + occlude(&o);
+}
+
+/* a new cached segment, closed unclipped */
+static void draw_segment(DrawJobs *d, int k) {
+  draw_range(d, &d->seg[k], d->start[k], d->end[k]);
+  segment_unclip(&d->seg[k]);
+  if (d->ctx->clip_batching) { batch_clips(d->ctx, &d->seg[k]); }
+  d->ref[k]->saved = d->ctx->occlusion ? occlude_segment(d->ctx, &d->seg[k]) : 0;
+}
+
+static void draw_job(void *data, int index) {
+  DrawJobs *d = data;
+  draw_segment(d, d->jobs[index]);
+}
+
+/* hash of everything draw_elem and the translations around it read, all in
+ * local space, so scrolling an ancestor keeps unclipped subtrees cached */
+static mu_Id draw_signature(mu_Context *ctx, mu_Elem *elem) {
+  mu_Id h = HASH_INITIAL;
+  int debug = elem->settings & MU_EL_DEBUG;
+  int t = elem->style.border_size;
+  mu_Rect clip = translate_rect(elem->draw_clip, mu_vec2(-elem->offset.x, -elem->offset.y));
+  mu_Rect outline = mu_rect(elem->rect.x - t, elem->rect.y - t, elem->rect.w + 2 * t, elem->rect.h + 2 * t);
+  mu_Rect visible[2];
+  mu_Vec2 scroll = elem_scroll(elem);
+  visible[0] = intersect_rects(outline, clip);
+  visible[1] = intersect_rects(elem->rect, clip);
+  hash(&h, &elem->rect, sizeof(elem->rect));
+  hash(&h, visible, sizeof(visible));
+  if (debug) { hash(&h, &clip, sizeof(clip)); }
+  hash(&h, &elem->cull, sizeof(elem->cull));
+  hash(&h, &debug, sizeof(debug));
+  hash(&h, &scroll, sizeof(scroll));
+  hash(&h, &elem->style, sizeof(elem->style));
+  if (elem->text.str) {
+    hash(&h, elem->text.str, strlen(elem->text.str) + 1);
+    hash(&h, &ctx->font_generation, sizeof(ctx->font_generation));
+  }
+  hash(&h, &elem->image, sizeof(elem->image));
+  return h;
+}
+
+/* versions of every subtree, children first so one backward pass suffices.
+ * A layer's version leaves out where it is clipped, its parent hashes that */
+static void subtree_versions(mu_Context *ctx, mu_Id *version) {
+  for (int i = ctx->element_stack.idx - 1; i >= 0; i--) {
+    mu_Elem *elem = &ctx->element_stack.items[i];
+    mu_Id v = draw_signature(ctx, elem);
+    if (!(elem->cull & MU_CULL_CHILDREN)) {
+      for (int c = 0; c < elem->tree.count; c++) {
+        mu_Elem *child = &ctx->element_stack.items[elem->tree.children[c]];
+        hash(&v, &version[child->idx], sizeof(mu_Id));
+        if (is_layer(child)) {
+          mu_Rect clip = translate_rect(child->clip, mu_vec2(-child->offset.x, -child->offset.y));
+          hash(&v, &clip, sizeof(clip));
+        }
+      }
+    }
+    version[i] = v;
+  }
+}
+
+/* the cache of the list the frame is built into, flushed when it ran full or
+ * when the passes its segments went through were switched */
+static mu_SegmentArena *segment_arena(mu_Context *ctx, int *slot) {
+  mu_SegmentArena *a = NULL;
+  for (int i = 0; i < MU_SEGCACHE_LISTS; i++) {
+    mu_SegmentArena *s = &ctx->seg_arenas[i];
+    if (s->list == ctx->command_list) { a = s; *slot = i; break; }
+    if (!a || s->last_frame < a->last_frame) { a = s; *slot = i; }
+  }
+  if (a->list != ctx->command_list || a->full ||
+      a->clip_batching != ctx->clip_batching || a->occlusion != ctx->occlusion) {
+    a->list = ctx->command_list;
+    a->top = MU_COMMANDLIST_SIZE - MU_SEGCACHE_SIZE;
+    a->gen++;
+    a->full = 0;
+    a->clip_batching = ctx->clip_batching;
+    a->occlusion = ctx->occlusion;
+  }
+  a->last_frame = ctx->frame;
+  return a;
+}
+
+static void draw_units(DrawJobs *d, mu_CommandSegment *seg, int idx);
+
+/* draws the subtree of child into seg, see `draw_units` */
+static void draw_unit(DrawJobs *d, mu_CommandSegment *seg, mu_Elem *child) {
+  mu_Context *ctx = d->ctx;
+  char *items = d->arena->list->items;
+  int start = child->idx;
+  int end = (child->cull & MU_CULL_CHILDREN) ? start + 1 : child->tree.end;
+  mu_SegmentRef *ref = &child->retained->seg[d->slot];
+  int known = ref->gen == d->arena->gen;
+  mu_Command *jump;
+  int size;
+  if (end - start < MU_SEGCACHE_MIN) {
+    draw_range(d, seg, start, end);
+    return;
+  }
+  if (known && ref->offset >= 0 && ref->version == d->version[start]) {
+    segment_unclip(seg);
+    jump = push_segment_command(seg, MU_COMMAND_JUMP, sizeof(mu_JumpCommand));
+    jump->jump.dst = items + ref->offset;
+    jump = (mu_Command*) (items + ref->offset + ref->size - command_size(mu_JumpCommand));
+    jump->jump.dst = seg->base + seg->idx;
+    d->saved += ref->saved;
+    return;
+  }
+  ref->gen = d->arena->gen;
+  ref->offset = -1;
+  if (known && ref->version != d->version[start]) {
+    ref->version = d->version[start];
+    draw_units(d, seg, start);
+    return;
+  }
+  ref->version = d->version[start];
+  size = command_size(mu_ClipCommand) + command_size(mu_JumpCommand) + command_size(mu_TranslateCommand);
+  for (int i = start; i < end; i = next_drawn(&ctx->element_stack.items[i])) {
+    size += elem_command_bound(&ctx->element_stack.items[i]);
+  }
+  size = align_command(size); // keeps the next segment aligned, strings have any length
+  if (d->arena->top + size > MU_COMMANDLIST_SIZE) {
+    d->arena->full = 1;
+    draw_range(d, seg, start, end);
+    return;
+  }
+  ref->offset = d->arena->top;
+  d->arena->top += size;
+  d->seg[d->count] = (mu_CommandSegment){ items + ref->offset, 0, size, size, reset_clip };
+  d->start[d->count] = start;
+  d->end[d->count] = end;
+  d->ref[d->count] = ref;
+  segment_unclip(seg);
+  jump = push_segment_command(seg, MU_COMMAND_JUMP, sizeof(mu_JumpCommand));
+  jump->jump.dst = d->seg[d->count].base;
+  d->ret[d->count] = seg->base + seg->idx;
+  d->count++;
+}
+
+/// @brief Emits an element and decides for each of its subtrees how to draw it.
+/// @param d The draw state of the frame.
+/// @param seg The segment the element is written into.
+/// @param idx The element.
+///
+/// A subtree whose version matches its cached commands is linked in with a
+/// jump; the cached segment's trailing jump is pointed back at `seg`. A subtree
+/// that changed since the last frame is opened up, so only the path down to
+/// the change is generated again. Other subtrees get a fresh segment in the
+/// cache and are queued as a job; they are reused from the next frame on.
+/// A child that is a layer is bracketed here, outside its cached commands.
+static void draw_units(DrawJobs *d, mu_CommandSegment *seg, int idx) {
+  mu_Context *ctx = d->ctx;
+  mu_Elem *elem = &ctx->element_stack.items[idx];
+  mu_Vec2 at = elem->offset;
+  draw_elem(ctx, seg, elem);
+  if ((elem->cull & MU_CULL_CHILDREN) || elem->tree.count == 0) { return; }
+  /* the children share one offset, every unit below starts and ends there */
+  segment_translate(seg, &at, ctx->element_stack.items[elem->tree.children[0]].offset);
+  for (int c = 0; c < elem->tree.count; c++) {
+    mu_Elem *child = &ctx->element_stack.items[elem->tree.children[c]];
+    mu_Command *layer = NULL;
+    if (is_layer(child) && !(child->cull & MU_CULL_SELF)) { layer = segment_begin_layer(seg, child, d->version[child->idx]); }
+    draw_unit(d, seg, child);
+    if (layer) { segment_end_layer(seg, layer); }
+  }
+  segment_translate(seg, &at, elem->offset);
+}
+
+/// @brief Generates the draw commands of all elements in painter's order.
+/// @param ctx The MicroUI context.
+///
+/// Subtrees keep their commands in a cache at the end of the command list,
+/// keyed by element id and a version hashed from everything that is drawn,
+/// and clean subtrees are linked into the frame with MU_COMMAND_JUMP instead
+/// of being generated again, see `draw_units`. Each command list has its own
+/// cache, so a list handed to a render thread is never patched.
+///
+/// Subtrees that need new cached commands are generated into private
+/// segments; when `ctx->parallel_for` is set, those of at least
+/// `ctx->parallel_threshold` elements are spread across workers.
+/// `mu_next_command` yields exactly the sequence of a plain serial pass.
+/// Elements and subtrees that are fully clipped are skipped beforehand, see
+/// `cull_elems`.
+///
+/// A clip command is only emitted where the clip the renderer is at would
+/// show a draw differently, see `segment_clip`. With `ctx->clip_batching`
+/// set, draws that do not overlap are also regrouped by clip, see
+/// `batch_clips`. With `ctx->occlusion` set, draws hidden by later opaque
+/// draws are dropped and `ctx->occluded_pixels` reports what that saved, see
+/// `occlude_segment`.
+///
+/// The subtree of an element with MU_EL_LAYER is drawn between
+/// MU_COMMAND_LAYER and MU_COMMAND_LAYER_END, clipped only to the element.
+/// The layer's version changes with its contents but not with its position
+/// or clip, so a renderer can keep the pixels and composite them instead.
+void mu_draw_debug_elems(mu_Context *ctx){
+  mu_CommandList *list = ctx->command_list;
+  mu_CommandSegment seg = { list->items + list->idx, 0, list->text - list->idx, list->text - list->idx, reset_clip };
+  DrawJobs d;
+  int njobs = 0;
+
+  apply_animations(ctx);
+  if (ctx->element_stack.idx == 0) { return; }
+  cull_elems(ctx);
+  subtree_versions(ctx, d.version);
+
+  d.ctx = ctx;
+  d.count = 0;
+  d.saved = 0;
+  d.arena = segment_arena(ctx, &d.slot);
+  draw_units(&d, &seg, 0);
+
+  for (int k = 0; k < d.count; k++) {
+    if (ctx->parallel_for && d.end[k] - d.start[k] >= ctx->parallel_threshold) {
+      d.jobs[njobs++] = k;
+    } else {
+      draw_segment(&d, k);
+    }
+  }
+  if (njobs) { ctx->parallel_for(draw_job, &d, njobs); }
+
+  /* close every new segment with a jump back into the frame */
+  for (int k = 0; k < d.count; k++) {
+    mu_Command *jump = push_segment_command(&d.seg[k], MU_COMMAND_JUMP, sizeof(mu_JumpCommand));
+    jump->jump.dst = d.ret[k];
+    d.ref[k]->size = d.seg[k].idx;
+    d.saved += d.ref[k]->saved;
+  }
+  segment_unclip(&seg);
+  if (ctx->clip_batching) { batch_clips(ctx, &seg); }
+  if (ctx->occlusion) { d.saved += occlude_segment(ctx, &seg); }
+  ctx->occluded_pixels = d.saved;
+  list->text = list->idx + seg.text;
+  list->idx += seg.idx;
+}
+
+
+
+
+static void advance_animations(mu_Context *ctx, mu_Time step) {
   for (int i = ctx->anim_stack.idx-1; i >=0 ; i--)
   {
     mu_Anim *it = &ctx->anim_stack.items[i];
-    
-    it->progress+= (double)dt / it->time; 
-    // printf("updating animation, anim index %d dt %f, time %f \n",i,(double)dt, it->time);
-    if (it->time==0){
-      it->progress=1;
-    }
+    it->elapsed += step;
+    /* progress is derived from integer time so replays end up bit-identical */
+    it->progress = (it->time==0) ? 1 : (double)it->elapsed / (it->time * 1000000.0);
     if (it->progress >=1.0){
-      // printf("anim finished\n");
+      mu_ElemState *st = mu_find_state(ctx, it->hash);
+      if (st) { st->anim = -1; }
       *it = ctx->anim_stack.items[--ctx->anim_stack.idx]; // if the animation is over we copy the last animation slot into the current one
+      if (i < ctx->anim_stack.idx && (st = mu_find_state(ctx, it->hash))) { st->anim = i; }
     }
+  }
+}
 
+/// @brief Advances all running animations by the last frame delta.
+/// @param ctx The MicroUI context.
+///
+/// With `ctx->fixed_step` set, the delta is accumulated and animations are
+/// advanced in whole steps of that size; the remainder carries over to the next
+/// frame. This keeps animation progress independent of the frame rate. After a
+/// stall (debugger, suspend, a slow first frame) at most MU_MAX_CATCHUP_STEPS
+/// are taken and the rest of the delta is dropped.
+void mu_animation_update(mu_Context *ctx) {
+  if (ctx->fixed_step > 0) {
+    int steps = 0;
+    ctx->time_accum += ctx->dt;
+    while (ctx->time_accum >= ctx->fixed_step && steps++ < MU_MAX_CATCHUP_STEPS) {
+      advance_animations(ctx, ctx->fixed_step);
+      ctx->time_accum -= ctx->fixed_step;
+    }
+    if (ctx->time_accum >= ctx->fixed_step) { ctx->time_accum %= ctx->fixed_step; }
+  } else {
+    advance_animations(ctx, ctx->dt);
   }
 }
 
@@ -1208,6 +2604,25 @@ void mu_add_text_to_elem(mu_Context *ctx,const char* text) {
   // elem->text_buffer[sizeof(elem->text_buffer)-1] = '\0'; // ensure null termination
   // elem->text.str = elem->text_buffer;
   elem->text.str=text;
+  elem->settings &= ~MU_EL_STATIC_TEXT;
+}
+
+/// @brief Sets the text of the current element to a string that never changes.
+/// @param ctx The MicroUI context.
+/// @param text A string that outlives every command list, e.g. a literal.
+///
+/// Same as `mu_add_text_to_elem`, but the text commands point at `text` instead
+/// of keeping a copy, also in the commands cached for later frames.
+void mu_add_static_text_to_elem(mu_Context *ctx,const char* text) {
+  mu_add_text_to_elem(ctx, text);
+  ctx->element_stack.items[ctx->element_stack.idx-1].settings |= MU_EL_STATIC_TEXT;
+}
+
+/// @brief Sets the image drawn over the current element's rect.
+/// @param ctx The MicroUI context.
+/// @param image The renderer's handle, which has to outlive every command list.
+void mu_add_image_to_elem(mu_Context *ctx, mu_Image image) {
+  ctx->element_stack.items[ctx->element_stack.idx-1].image = image;
 }
 
 void mu_set_global_style(mu_Context *ctx, mu_Style style)
@@ -1233,23 +2648,18 @@ void mu_animation_add(mu_Context *ctx,
                       unsigned int hash
                     ){
 
-  for (int i = 0; i < ctx->anim_stack.idx; i++)
-  {
-    mu_Anim *anim = &ctx->anim_stack.items[i];
-    if (anim->hash==hash){
-
-      anim->initial= anim->prev;
-      anim->time=time;      
-      anim->progress=(time==0) ? 1 : 0;
-
-      return;
-      // if (animable.set_flags != anim->animable.set_flags){
-        
-      // }
-    }
+  mu_ElemState *st = mu_get_state(ctx, hash);
+  if (st->anim >= 0) {
+    mu_Anim *anim = &ctx->anim_stack.items[st->anim];
+    anim->initial= anim->prev;
+    anim->time=time;      
+    anim->progress=(time==0) ? 1 : 0;
+    anim->elapsed=0;
+    return;
   }
   if (ctx->anim_stack.idx<MU_ANIMSTACK_SIZE){
     // printf("adding animaiton");
+    st->anim = ctx->anim_stack.idx;
     ctx->anim_stack.items[ctx->anim_stack.idx++]=(mu_Anim) {
       animable,
       hash,
@@ -1257,7 +2667,8 @@ void mu_animation_add(mu_Context *ctx,
       (time==0) ? 1 : 0,
       time,
       animable,
-      animable
+      animable,
+      0
     };
   }
 
@@ -1318,6 +2729,9 @@ void mu_adjust_style(mu_Context *ctx, mu_StyleOverride override) {
     if (override.set_flags & MU_STYLE_SCROLL_Y)
         buf.scroll.y = override.scroll.y;
 
+    if (override.set_flags & MU_STYLE_RADIUS)
+        buf.radius = override.radius;
+
     mu_add_style(ctx, buf);
 }
 
@@ -1364,4 +2778,40 @@ void mu_end_elem_window(mu_Context *ctx) {
   mu_pop_id(ctx);
 
   // mu_print_debug_tree(ctx);
-}
\ No newline at end of file
+}
+
+
+/// @brief Fills `list->offsets` from the size callback.
+/// @param list The virtual list.
+///
+/// `offsets[i]` is the start of item i and `offsets[count]` the total extent.
+/// Call it whenever item sizes change; it is the only O(n) list operation.
+void mu_list_build_offsets(mu_List *list) {
+  list->offsets[0] = 0;
+  for (int i = 0; i < list->count; i++) {
+    list->offsets[i + 1] = list->offsets[i] + list->size(list->data, i);
+  }
+}
+
+/// @brief Returns the start of an item along the list, relative to item 0.
+/// @param list The virtual list.
+/// @param index Item index in [0, count]; `count` yields the total extent.
+int mu_list_offset(mu_List *list, int index) {
+  return list->size ? list->offsets[index] : index * list->extent;
+}
+
+/// @brief Finds the item covering a position along the list.
+/// @param list The virtual list.
+/// @param pos Position relative to the start of item 0.
+/// @return The item index, clamped to [0, count - 1]. Binary search over the
+/// prefix sums, or a division for uniform extents.
+int mu_list_index_at(mu_List *list, int pos) {
+  int lo = 0, hi = list->count - 1;
+  if (list->count == 0) { return 0; }
+  if (!list->size) { return mu_clamp(pos / list->extent, 0, hi); }
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if (list->offsets[mid] <= pos) { lo = mid; } else { hi = mid - 1; }
+  }
+  return lo;
+}
@@ -3,10 +3,17 @@
 #include <SDL2/SDL_ttf.h>
 #include <assert.h>
 #include "renderer.h"
+#include "sdffont.h"
+#include "loader.h"
+#include "images.h"
 #include "atlas.inl"
 #include <stdio.h>
+#include <string.h>
 
 #define BUFFER_SIZE 16384
+#define LAYER_STACK_SIZE 32
+#define DEFAULT_IMAGE_BUDGET (32 << 20) // bytes
+#define IMAGE_UPLOAD_BYTES (4 << 20) // a frame
 
 static GLfloat   tex_buf[BUFFER_SIZE *  8];
 static GLfloat  vert_buf[BUFFER_SIZE *  8];
@@ -16,8 +23,18 @@ static GLuint  index_buf[BUFFER_SIZE *  6];
 static int width  = 800;
 static int height = 480;
 static int buf_idx;
+static mu_Vec2 translation; // MU_COMMAND_TRANSLATE, applied to quads and clip rects
+static mu_Rect scissor;
+static r_DrawStats draw_stats;
+static Uint64 first_present; // performance counter at the first r_present
+static mu_Rect bound; // every clip rect is limited to this within a layer
+static mu_Rect layer_stack[LAYER_STACK_SIZE][2]; // scissor and bound to restore
+static int layer_depth;
 
 static SDL_Window *window;
+static SDL_GLContext gl_context;
+static SDL_mutex *ttf_lock;
+static GLuint atlas_id; // bound again after a string was drawn from its own texture
 
 // Function to print out OpenGL error messages.
 // This function will check for all errors that might have been queued.
@@ -50,12 +67,18 @@ void checkOpenGLError(const char* file, int line) {
 #define CHECK_GL_ERROR() checkOpenGLError(__FILE__, __LINE__)
 
 
+// The fixed-function pipeline has no programs to cache.
+void r_set_program_cache(const char *path) {
+  (void)path;
+}
+
+
 void r_init(void) {
   /* init SDL window */
   window = SDL_CreateWindow(
     NULL, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
     width, height, SDL_WINDOW_OPENGL);
-  SDL_GL_CreateContext(window);
+  gl_context = SDL_GL_CreateContext(window);
 
   /* init gl */
   glEnable(GL_BLEND);
@@ -69,26 +92,36 @@ void r_init(void) {
   glEnableClientState(GL_COLOR_ARRAY);
 
   /* init texture */
-  GLuint id;
-  glGenTextures(1, &id);
-  glBindTexture(GL_TEXTURE_2D, id);
+  glGenTextures(1, &atlas_id);
+  glBindTexture(GL_TEXTURE_2D, atlas_id);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, ATLAS_WIDTH, ATLAS_HEIGHT, 0,
     GL_ALPHA, GL_UNSIGNED_BYTE, atlas_texture);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   assert(glGetError() == 0);
 
+  ttf_lock = SDL_CreateMutex(); /* SDL_ttf is initialized by the first TTF font */
+
+
+}
+
+
+/* FreeType is only started for fonts rasterized at runtime, not for packs */
+static void init_ttf(void) {
+  static int ready;
+  if (ready) return;
   if (TTF_Init() == -1) {
       fprintf(stderr, "Failed to init SDL_ttf: %s\n", TTF_GetError());
       exit(1);
   }
-
-
+  ready = 1;
 }
 
-
 void r_load_font(mu_Font *font, const char* path, unsigned char size) {
-  *font = TTF_OpenFont(path, size);
+  SDL_LockMutex(ttf_lock);
+  init_ttf();
+  SDL_AtomicSetPtr(font, TTF_OpenFont(path, size));
+  SDL_UnlockMutex(ttf_lock);
   if (!*font) {
       fprintf(stderr, "Failed to load font: %s\n", TTF_GetError());
       exit(1);
@@ -97,6 +130,137 @@ void r_load_font(mu_Font *font, const char* path, unsigned char size) {
   }
 }
 
+/* distance-field fonts are drawn by the software kernel, see draw_sdf_text */
+static sdf_Font sdf_fonts[8];
+static int sdf_font_count;
+
+static sdf_Font *new_sdf_font(void) {
+  if (sdf_font_count == 8) {
+      fprintf(stderr, "Failed to load font: too many distance-field fonts\n");
+      exit(1);
+  }
+  return &sdf_fonts[sdf_font_count];
+}
+
+void r_load_sdf_font(mu_Font *font, const char *path, unsigned char size) {
+  sdf_Font *f = new_sdf_font();
+  SDL_LockMutex(ttf_lock);
+  init_ttf();
+  int ok = sdf_load(f, path, size, NULL);
+  SDL_UnlockMutex(ttf_lock);
+  if (!ok) {
+      fprintf(stderr, "Failed to load font: %s\n", path);
+      exit(1);
+  }
+  sdf_font_count++;
+  *font = sdf_face(f, size, 0);
+}
+
+void r_load_font_pack(mu_Font *font, const char *path, const char *name, unsigned char size) {
+  sdf_Font *f = new_sdf_font();
+  if (!sdf_map(f, path, name)) {
+      fprintf(stderr, "Failed to map font pack: %s\n", path);
+      exit(1);
+  }
+  sdf_font_count++;
+  *font = sdf_face(f, size, 0);
+}
+
+/* fonts loaded on the loader thread, see r_load_font_async */
+typedef struct {
+  mu_Font *handle; /* a TTF font is stored here when it is open */
+  sdf_Font *sdf; /* a distance-field font is marked ready when it is built */
+  char path[512];
+  unsigned char size;
+} FontLoad;
+
+static FontLoad font_loads[16];
+static int font_load_count;
+static SDL_atomic_t font_generation; /* fonts the loader thread finished */
+
+static void load_font_task(void *data) {
+  FontLoad *l = data;
+  SDL_LockMutex(ttf_lock);
+  init_ttf();
+  if (l->sdf) {
+    if (sdf_load(l->sdf, l->path, l->size, NULL)) {
+      SDL_AtomicIncRef(&font_generation);
+    }
+    else { fprintf(stderr, "Failed to load font: %s\n", l->path); }
+  } else {
+    TTF_Font *ttf = TTF_OpenFont(l->path, l->size);
+    if (ttf) {
+      SDL_AtomicSetPtr(l->handle, ttf);
+      SDL_AtomicIncRef(&font_generation);
+    }
+    else { fprintf(stderr, "Failed to load font: %s\n", TTF_GetError()); }
+  }
+  SDL_UnlockMutex(ttf_lock);
+}
+
+static FontLoad *new_font_load(const char *path, unsigned char size) {
+  if (font_load_count == 16) {
+      fprintf(stderr, "Failed to load font: too many font loads\n");
+      exit(1);
+  }
+  FontLoad *l = &font_loads[font_load_count++];
+  SDL_strlcpy(l->path, path, sizeof(l->path));
+  l->size = size;
+  return l;
+}
+
+/* the built-in atlas font stands in until the loader thread is done */
+void r_load_font_async(mu_Font *font, const char *path, unsigned char size) {
+  FontLoad *l = new_font_load(path, size);
+  SDL_AtomicSetPtr(font, NULL);
+  l->handle = font;
+  ld_submit(load_font_task, l);
+}
+
+void r_load_sdf_font_async(mu_Font *font, const char *path, unsigned char size) {
+  FontLoad *l = new_font_load(path, size);
+  l->sdf = new_sdf_font();
+  sdf_font_count++;
+  *font = sdf_face(l->sdf, size, 0);
+  ld_submit(load_font_task, l);
+}
+
+int r_font_generation(void) {
+  return SDL_AtomicGet(&font_generation);
+}
+
+/* a face whose atlas is built, or a TTF font that is open; with neither the
+ * built-in atlas font is used */
+static sdf_Face *ready_face(mu_Font font) {
+  if (!sdf_is_face(font)) return NULL;
+  sdf_Face *face = font;
+  return sdf_ready(face->font) ? face : NULL;
+}
+
+static TTF_Font *ttf_font(mu_Font font) {
+  return font && !sdf_is_face(font) ? SDL_AtomicGetPtr(font) : NULL;
+}
+
+mu_Font r_font_face(mu_Font font, float size, float weight) {
+  if (!sdf_is_face(font)) return font;
+  sdf_Face *face = sdf_face(((sdf_Face*)font)->font, size, weight);
+  return face ? face : font;
+}
+
+void r_acquire_context(void) {
+  SDL_GL_MakeCurrent(window, gl_context);
+}
+
+
+void r_release_context(void) {
+  SDL_GL_MakeCurrent(window, NULL);
+}
+
+/* this backend always uploads the whole frame */
+void r_set_retained(int on) {
+  (void)on;
+}
+
 static void flush(void) {
   if (buf_idx == 0) { return; }
 
@@ -113,6 +277,7 @@ static void flush(void) {
   glVertexPointer(2, GL_FLOAT, 0, vert_buf);
   glColorPointer(4, GL_UNSIGNED_BYTE, 0, color_buf);
   glDrawElements(GL_TRIANGLES, buf_idx * 6, GL_UNSIGNED_INT, index_buf);
+  draw_stats.flushes++;
 
   glMatrixMode(GL_MODELVIEW);
   glPopMatrix();
@@ -123,6 +288,8 @@ static void flush(void) {
 }
 
 static void push_raw_quad(mu_Rect dst, float uv[8], mu_Color color) {
+    dst.x += translation.x;
+    dst.y += translation.y;
     if (buf_idx == BUFFER_SIZE) { flush(); }
 
     int texvert_idx = buf_idx *  8;
@@ -160,6 +327,8 @@ static void push_raw_quad(mu_Rect dst, float uv[8], mu_Color color) {
 }
 
 static void push_quad(mu_Rect dst, mu_Rect src, mu_Color color) {
+  dst.x += translation.x;
+  dst.y += translation.y;
   if (buf_idx == BUFFER_SIZE) { flush(); }
 
   int texvert_idx = buf_idx *  8;
@@ -213,13 +382,103 @@ void r_draw_rect(mu_Rect rect, mu_Color color) {
 }
 
 
-void r_draw_text(const char *text, mu_Font font, mu_Vec2 pos, mu_Color color) {
+/* columns a rounded corner of radius r cuts off in row y, 0 being the edge */
+static int corner_inset(int r, int y) {
+  int dy = 2 * (r - y) - 1; /* half pixels from the corner's center */
+  int x = 0;
+  if (y >= r) { return 0; }
+  while (x < r && (2 * (r - x) - 1) * (2 * (r - x) - 1) + dy * dy > 4 * r * r) { x++; }
+  return x;
+}
+
+
+static void box_span(mu_Rect rect, int x0, int x1, int y, int h, mu_Color color) {
+  if (x1 > x0 && h > 0 && color.a) { r_draw_rect(mu_rect(rect.x + x0, y, x1 - x0, h), color); }
+}
+
+
+/* rows [y, y + h) of a box, all of them at distance `edge` from its nearest edge */
+static void box_rows(mu_Rect rect, int y, int h, int edge, mu_Color color, mu_Color border, int b, int r) {
+  int outer = corner_inset(r, edge);
+  int inner;
+  if (edge < b) {
+    box_span(rect, outer, rect.w - outer, y, h, border);
+    return;
+  }
+  inner = b + corner_inset(mu_max(r - b, 0), edge - b);
+  box_span(rect, outer, inner, y, h, border);
+  box_span(rect, inner, rect.w - inner, y, h, color);
+  box_span(rect, rect.w - inner, rect.w - outer, y, h, border);
+}
+
+
+/* drawn as horizontal spans: the rows with rounded corners or the top and
+ * bottom border one at a time, the rows in between as one block */
+void r_draw_box(mu_Rect rect, mu_Color color, mu_Color border, int border_width, int radius) {
+  int r = mu_max(mu_min(radius, mu_min(rect.w, rect.h) / 2), 0);
+  int rows = mu_min(mu_max(r, border_width), (rect.h + 1) / 2);
+  for (int y = 0; y < rows; y++) {
+    box_rows(rect, rect.y + y, 1, y, color, border, border_width, r);
+    if (rect.h - 1 - y != y) { box_rows(rect, rect.y + rect.h - 1 - y, 1, y, color, border, border_width, r); }
+  }
+  box_rows(rect, rect.y + rows, rect.h - 2 * rows, rows, color, border, border_width, r);
+}
+
+
+/* coverage from the distance-field atlas, drawn as an alpha texture */
+static void draw_sdf_text(const char *text, int len, const sdf_Face *face, mu_Vec2 pos, mu_Color color) {
+    int w = (int)sdf_text_width(face, text, len) + 1, h = sdf_line_height(face);
+    unsigned char *coverage = malloc(w * h);
+    if (!coverage) return;
+    sdf_render(face, text, len, coverage, w, h);
+
+    GLuint texid;
+    glGenTextures(1, &texid);
+    glBindTexture(GL_TEXTURE_2D, texid);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, w, h, 0, GL_ALPHA, GL_UNSIGNED_BYTE, coverage);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    free(coverage);
+
+    float uv[8] = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+    push_raw_quad(mu_rect(pos.x, pos.y, w, h), uv, color);
+    flush();
+    glDeleteTextures(1, &texid);
+    glBindTexture(GL_TEXTURE_2D, atlas_id);
+}
+
+static void draw_atlas_text(const char *text, int len, mu_Vec2 pos, mu_Color color) {
+  mu_Rect dst = { pos.x, pos.y, 0, 0 };
+  for (const char *p = text; p < text + len; p++) {
+    if ((*p & 0xc0) == 0x80) { continue; }
+    int chr = mu_min((unsigned char) *p, 127);
+    mu_Rect src = atlas[ATLAS_FONT + chr];
+    dst.w = src.w;
+    dst.h = src.h;
+    push_quad(dst, src, color);
+    dst.x += dst.w;
+  }
+}
+
+void r_draw_text(const char *text, int len, mu_Id hash, mu_Font font, mu_Vec2 pos, mu_Color color) {
+    (void) hash; // text is NUL-terminated, every string is rendered anew
+    sdf_Face *face = ready_face(font);
+    TTF_Font *ttf = ttf_font(font);
+    if (!face && !ttf) {
+      draw_atlas_text(text, len, pos, color); // no font, or still loading
+      return;
+    }
     flush(); // Render pending atlas stuff first
-    if (font == NULL) {
-      // printf("FONT IS NULL, ADD FEATURE TO REVERT TO STANDARD FONT\n");
+    if (face) {
+      draw_sdf_text(text, len, face, pos, color);
+      return;
     }
     SDL_Color sdl_color = { color.r, color.g, color.b, color.a };
-    SDL_Surface *surface = TTF_RenderUTF8_Blended(*(TTF_Font**)font, text, sdl_color);
+    SDL_LockMutex(ttf_lock);
+    SDL_Surface *surface = TTF_RenderUTF8_Blended(ttf, text, sdl_color);
+    SDL_UnlockMutex(ttf_lock);
     if (!surface) return;
 
     GLuint texid;
@@ -244,6 +503,7 @@ void r_draw_text(const char *text, mu_Font font, mu_Vec2 pos, mu_Color color) {
     flush(); // Render text immediately
     SDL_FreeSurface(rgba_surface);
     glDeleteTextures(1, &texid);
+    glBindTexture(GL_TEXTURE_2D, atlas_id);
 }
 
 void r_draw_icon(int id, mu_Rect rect, mu_Color color) {
@@ -256,7 +516,17 @@ void r_draw_icon(int id, mu_Rect rect, mu_Color color) {
 
 int r_get_text_width(mu_Font font, const char *text, int len) {
   
-    if (!font) return 0;
+    sdf_Face *face = ready_face(font);
+    TTF_Font *ttf = ttf_font(font);
+    if (face) return (int)(sdf_text_width(face, text, len) + 0.5f);
+    if (!ttf) {
+      int res = 0;
+      for (const char *p = text; *p && len--; p++) {
+        if ((*p & 0xc0) == 0x80) { continue; }
+        res += atlas[ATLAS_FONT + mu_min((unsigned char) *p, 127)].w;
+      }
+      return res;
+    }
     
     // Create null-terminated string from the given length
     char *chars = (char *)calloc(len + 1, 1);
@@ -264,7 +534,10 @@ int r_get_text_width(mu_Font font, const char *text, int len) {
     
     int width = 0;
     int height = 0;
-    if (TTF_SizeUTF8(*(TTF_Font**)font, chars, &width, &height) < 0) {
+    SDL_LockMutex(ttf_lock);
+    int err = TTF_SizeUTF8(ttf, chars, &width, &height);
+    SDL_UnlockMutex(ttf_lock);
+    if (err < 0) {
         fprintf(stderr, "Error: could not measure text: %s\n", TTF_GetError());
         free(chars);
         return 0;
@@ -278,20 +551,201 @@ int r_get_text_width(mu_Font font, const char *text, int len) {
 int r_get_text_height(mu_Font font) {
 
 
-    if (!font) return 18; // fallback
+    sdf_Face *face = ready_face(font);
+    TTF_Font *ttf = ttf_font(font);
+    if (face) return sdf_line_height(face);
+    if (!ttf) return 18; // built-in font
     
-    return TTF_FontHeight(*(TTF_Font**)font);
+    SDL_LockMutex(ttf_lock);
+    int h = TTF_FontHeight(ttf);
+    SDL_UnlockMutex(ttf_lock);
+    return h;
 }
 
 
-void r_set_clip_rect(mu_Rect rect) {
+static mu_Rect intersect_rects(mu_Rect a, mu_Rect b) {
+  int x1 = mu_max(a.x, b.x);
+  int y1 = mu_max(a.y, b.y);
+  int x2 = mu_min(a.x + a.w, b.x + b.w);
+  int y2 = mu_min(a.y + a.h, b.y + b.h);
+  if (x2 < x1) { x2 = x1; }
+  if (y2 < y1) { y2 = y1; }
+  return mu_rect(x1, y1, x2 - x1, y2 - y1);
+}
+
+
+/* nothing is flushed when the scissor rect is already set */
+static void apply_clip(mu_Rect rect) {
+  if (!memcmp(&rect, &scissor, sizeof(rect))) { return; }
   flush();
+  draw_stats.clips++;
+  scissor = rect;
   glScissor(rect.x, height - (rect.y + rect.h), rect.w, rect.h);
 }
 
 
+void r_set_clip_rect(mu_Rect rect) {
+  rect.x += translation.x;
+  rect.y += translation.y;
+  apply_clip(intersect_rects(rect, bound));
+}
+
+
+/* this backend has no offscreen targets, every layer is drawn through */
+int r_begin_layer(mu_Id id, mu_Id version, mu_Rect rect, mu_Rect clip) {
+  (void)id; (void)version; (void)rect;
+  assert(layer_depth < LAYER_STACK_SIZE);
+  layer_stack[layer_depth][0] = scissor;
+  layer_stack[layer_depth][1] = bound;
+  layer_depth++;
+  clip.x += translation.x;
+  clip.y += translation.y;
+  bound = intersect_rects(clip, bound);
+  apply_clip(bound);
+  return 0;
+}
+
+
+void r_end_layer(void) {
+  assert(layer_depth > 0);
+  layer_depth--;
+  bound = layer_stack[layer_depth][1];
+  apply_clip(layer_stack[layer_depth][0]);
+}
+
+
+void r_set_layer_budget(int bytes) {
+  (void)bytes;
+}
+
+
+r_LayerStats r_layer_stats(void) {
+  r_LayerStats s = { 0, 0, 0, 0, 0 };
+  return s;
+}
+
+
+/* images, decoded on loader threads (images.c). Each gets a texture of its
+ * own, uploaded from client memory within IMAGE_UPLOAD_BYTES a frame; the
+ * textures are kept within image_budget bytes, least recently drawn first out */
+typedef struct {
+  GLuint texture; // 0 when not uploaded
+  int w, h;
+  int last_used; // frame
+  int held; // the image's pixels, until they are uploaded
+} ImageTexture;
+
+static ImageTexture image_textures[IMG_MAX_IMAGES];
+static int image_bytes;
+static int image_budget = DEFAULT_IMAGE_BUDGET;
+static int image_upload_left; // bytes this frame may still upload
+static r_ImageStats image_stats;
+
+
+mu_Image r_load_image(const char *path) {
+  return img_create(path);
+}
+
+
+/* frees the least recently drawn texture not drawn in this frame */
+static int evict_image(void) {
+  ImageTexture *lru = NULL;
+  for (int i = 0; i < IMG_MAX_IMAGES; i++) {
+    ImageTexture *t = &image_textures[i];
+    if (!t->texture || t->last_used == draw_stats.frames) { continue; }
+    if (!lru || t->last_used < lru->last_used) { lru = t; }
+  }
+  if (!lru) { return 0; }
+  glDeleteTextures(1, &lru->texture);
+  lru->texture = 0;
+  image_bytes -= lru->w * lru->h * 4;
+  image_stats.evictions++;
+  return 1;
+}
+
+
+/* the texture of a decoded image, 0 while it is decoding or does not fit */
+static GLuint upload_image(img_Image *image, ImageTexture *t) {
+  int w, h;
+  if (!t->held) {
+    img_hold(image);
+    t->held = 1;
+  }
+  if (img_request(image) != IMG_DECODED) { return 0; }
+  const unsigned char *pixels = img_pixels(image, &w, &h);
+  if (w * h * 4 > image_upload_left && image_upload_left < IMAGE_UPLOAD_BYTES) { return 0; } /* next frame */
+  while (image_bytes + w * h * 4 > image_budget) {
+    if (!evict_image()) {
+      if (image_bytes > 0) { return 0; }
+      break; /* larger than the budget alone */
+    }
+  }
+  glGenTextures(1, &t->texture);
+  glBindTexture(GL_TEXTURE_2D, t->texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  img_release(image);
+  t->held = 0;
+  t->w = w;
+  t->h = h;
+  image_bytes += w * h * 4;
+  image_upload_left -= w * h * 4;
+  image_stats.uploads++;
+  return t->texture;
+}
+
+
+// Draws the image stretched over rect, faded by color.a; nothing until it is
+// decoded and uploaded.
+void r_draw_image(mu_Image image, mu_Rect rect, mu_Color color) {
+  img_Image *img = image;
+  if (!img) { return; }
+  ImageTexture *t = &image_textures[img_index(img)];
+  t->last_used = draw_stats.frames;
+  flush(); // pending atlas quads
+  if (!t->texture && !upload_image(img, t)) {
+    glBindTexture(GL_TEXTURE_2D, atlas_id);
+    return;
+  }
+  float uv[8] = { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+  glBindTexture(GL_TEXTURE_2D, t->texture);
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA); // the pixels are premultiplied
+  push_raw_quad(rect, uv, mu_color(color.a, color.a, color.a, color.a));
+  flush();
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glBindTexture(GL_TEXTURE_2D, atlas_id);
+}
+
+
+void r_set_image_budget(int bytes) {
+  image_budget = bytes;
+  while (image_bytes > image_budget && evict_image()) {}
+}
+
+
+r_ImageStats r_image_stats(void) {
+  r_ImageStats s = image_stats;
+  s.decoding = img_decoding();
+  s.bytes = image_bytes;
+  return s;
+}
+
+
+void r_translate(mu_Vec2 delta) {
+  translation.x += delta.x;
+  translation.y += delta.y;
+}
+
+
 void r_clear(mu_Color clr) {
   flush();
+  image_upload_left = IMAGE_UPLOAD_BYTES;
+  translation = mu_vec2(0, 0);
+  bound = mu_rect(0, 0, width, height);
+  scissor = bound;
+  glScissor(bound.x, height - (bound.y + bound.h), bound.w, bound.h);
+  layer_depth = 0;
   glClearColor(clr.r / 255., clr.g / 255., clr.b / 255., clr.a / 255.);
   glClear(GL_COLOR_BUFFER_BIT);
 }
@@ -300,4 +754,17 @@ void r_clear(mu_Color clr) {
 void r_present(void) {
   flush();
   SDL_GL_SwapWindow(window);
+  if (!first_present) { first_present = SDL_GetPerformanceCounter(); }
+  draw_stats.frames++;
+}
+
+
+// Performance counter at the first r_present, 0 before it.
+unsigned long long r_first_present(void) {
+  return first_present;
+}
+
+
+r_DrawStats r_draw_stats(void) {
+  return draw_stats;
 }
\ No newline at end of file
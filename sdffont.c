@@ -0,0 +1,479 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L // mmap
+#endif
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "sdffont.h"
+
+/* Distance-field fonts: every glyph is rasterized once, at one size, and
+ * stored as its signed distance to the outline. Sampling that with linear
+ * filtering and cutting at the edge value gives sharp text at any size, so
+ * one atlas serves every size and weight of a font. The GLES renderer does
+ * the cut in its fragment shader, sdf_render is the same kernel in software.
+ *
+ * The atlas is one byte per texel, SDF_ATLAS_WIDTH wide, packed in shelves
+ * and cut down to the next power of two in height once all glyphs are in.
+ *
+ * Fonts baked offline by tools/fontbake are kept in a pack: a header, one
+ * entry per font, then each font's glyphs, kerning pairs and atlas as they
+ * are laid out in memory (little endian). sdf_map maps a pack and points the
+ * font into it, so nothing is rasterized and no page is read before the
+ * renderer uploads the atlas. */
+
+#define MAX_ATLAS_HEIGHT 2048
+
+static sdf_Face faces[SDF_MAX_FACES];
+static int face_count;
+
+typedef struct {
+  char magic[4]; // "MUFP"
+  int version; // SDF_PACK_VERSION
+  int count; // entries that follow
+} PackHeader;
+
+/* offsets are from the start of the pack */
+typedef struct {
+  char name[SDF_PACK_NAME];
+  int size, height, atlas_w, atlas_h, kern_count;
+  int glyphs, kerning, atlas;
+} PackEntry;
+
+int sdf_begin(sdf_Font *font, int size, int height) {
+  memset(font, 0, sizeof(*font));
+  font->atlas = calloc(SDF_ATLAS_WIDTH, MAX_ATLAS_HEIGHT);
+  if (!font->atlas) { return 0; }
+  font->size = size;
+  font->height = height;
+  font->atlas_w = SDF_ATLAS_WIDTH;
+  font->atlas_h = MAX_ATLAS_HEIGHT;
+  return 1;
+}
+
+static int isqrt_scaled(int d2) {
+  /* sqrt(d2) * 16, d2 is small */
+  int r = 0;
+  while ((r + 1) * (r + 1) <= d2 * 256) { r++; }
+  return r;
+}
+
+/* signed distance at a bitmap pixel in 1/16 pixels, inside is positive */
+static int distance(const unsigned char *coverage, int w, int h, int pitch, int x, int y) {
+  const int reach = SDF_SPREAD + 1;
+  int a = (x >= 0 && y >= 0 && x < w && y < h) ? coverage[y * pitch + x] : 0;
+  int inside = a >= 128, best = reach * reach * 2;
+  /* antialiased pixels already say how far the edge runs through them */
+  if (a > 0 && a < 255) { return (a - 128) * 16 / 255; }
+  for (int dy = -reach; dy <= reach; dy++) {
+    for (int dx = -reach; dx <= reach; dx++) {
+      int sx = x + dx, sy = y + dy, d2 = dx * dx + dy * dy, b;
+      if (d2 >= best) { continue; }
+      b = (sx >= 0 && sy >= 0 && sx < w && sy < h) ? coverage[sy * pitch + sx] : 0;
+      if ((b >= 128) != inside) { best = d2; }
+    }
+  }
+  return inside ? isqrt_scaled(best) - 8 : 8 - isqrt_scaled(best);
+}
+
+/// Adds a glyph from its coverage bitmap, whose top left is `left`, `top`
+/// pixels from the pen at the top of the line. Returns 0 when the atlas is
+/// full or the codepoint has no slot.
+int sdf_add_glyph(sdf_Font *font, int codepoint, const unsigned char *coverage, int w, int h, int pitch, int left, int top, int advance) {
+  int x0 = w, y0 = h, x1 = 0, y1 = 0, pw, ph;
+  sdf_Glyph *g;
+  if (codepoint < SDF_FIRST_GLYPH || codepoint >= SDF_FIRST_GLYPH + SDF_GLYPHS) { return 0; }
+  g = &font->glyphs[codepoint - SDF_FIRST_GLYPH];
+  memset(g, 0, sizeof(*g));
+  g->advance = advance;
+  /* only the inked part is stored, padded by the spread */
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      if (!coverage[y * pitch + x]) { continue; }
+      if (x < x0) { x0 = x; }
+      if (y < y0) { y0 = y; }
+      if (x >= x1) { x1 = x + 1; }
+      if (y >= y1) { y1 = y + 1; }
+    }
+  }
+  if (x1 <= x0) { return 1; } /* blank, e.g. space */
+  pw = x1 - x0 + 2 * SDF_SPREAD;
+  ph = y1 - y0 + 2 * SDF_SPREAD;
+  if (font->pen_x + pw > font->atlas_w) {
+    font->pen_x = 0;
+    font->pen_y += font->row_h;
+    font->row_h = 0;
+  }
+  if (pw > font->atlas_w || font->pen_y + ph > font->atlas_h) { return 0; }
+  for (int y = 0; y < ph; y++) {
+    unsigned char *row = font->atlas + (font->pen_y + y) * font->atlas_w + font->pen_x;
+    for (int x = 0; x < pw; x++) {
+      int d = distance(coverage, w, h, pitch, x0 + x - SDF_SPREAD, y0 + y - SDF_SPREAD);
+      int v = 128 + d * 127 / (16 * SDF_SPREAD);
+      row[x] = v < 0 ? 0 : v > 255 ? 255 : v;
+    }
+  }
+  g->x = font->pen_x;
+  g->y = font->pen_y;
+  g->w = pw;
+  g->h = ph;
+  g->left = left + x0 - SDF_SPREAD;
+  g->top = top + y0 - SDF_SPREAD;
+  font->pen_x += pw;
+  if (ph > font->row_h) { font->row_h = ph; }
+  return 1;
+}
+
+/* drops the atlas rows no glyph reached, then publishes the font to other
+ * threads */
+void sdf_end(sdf_Font *font) {
+  int used = font->pen_y + font->row_h, h = 1;
+  unsigned char *atlas;
+  while (h < used) { h *= 2; }
+  atlas = realloc(font->atlas, font->atlas_w * h);
+  if (atlas) { font->atlas = atlas; font->atlas_h = h; }
+  SDL_AtomicSet(&font->ready, 1);
+}
+
+static int in_set(const char *glyphs, int c) {
+  return !glyphs || c == '?' || (c && strchr(glyphs, c)); /* '?' stands in for the rest */
+}
+
+/* the pairs of baked glyphs the font kerns */
+static void load_kerning(sdf_Font *font, TTF_Font *ttf, const char *glyphs) {
+  sdf_Kern *pairs = malloc(SDF_GLYPHS * SDF_GLYPHS * sizeof(sdf_Kern));
+  int n = 0;
+  if (!pairs) { return; }
+  for (int l = 0; l < SDF_GLYPHS; l++) {
+    if (!in_set(glyphs, SDF_FIRST_GLYPH + l)) { continue; }
+    for (int r = 0; r < SDF_GLYPHS; r++) {
+      int k;
+      if (!in_set(glyphs, SDF_FIRST_GLYPH + r)) { continue; }
+      k = TTF_GetFontKerningSizeGlyphs32(ttf, SDF_FIRST_GLYPH + l, SDF_FIRST_GLYPH + r);
+      if (k) { pairs[n++] = (sdf_Kern){ l, r, k }; }
+    }
+  }
+  font->kerning = n ? realloc(pairs, n * sizeof(sdf_Kern)) : NULL;
+  font->kern_count = font->kerning ? n : 0;
+  if (!font->kerning) { free(pairs); }
+}
+
+/// Rasterizes a TrueType font into a distance-field atlas at `size` pixels.
+/// `glyphs` limits the atlas to those characters, NULL bakes every printable
+/// ASCII one. TTF_Init must have been called; SDL_ttf is not thread safe, so
+/// callers sharing it with another thread hold their lock around this.
+/// Returns 0 on failure.
+int sdf_load(sdf_Font *font, const char *path, int size, const char *glyphs) {
+  SDL_Color white = { 255, 255, 255, 255 };
+  unsigned char *coverage;
+  TTF_Font *ttf = TTF_OpenFont(path, size);
+  int ok;
+  if (!ttf) { return 0; }
+  ok = sdf_begin(font, size, TTF_FontHeight(ttf));
+  for (int c = SDF_FIRST_GLYPH; ok && c < SDF_FIRST_GLYPH + SDF_GLYPHS; c++) {
+    int minx, maxx, miny, maxy, advance;
+    SDL_Surface *s;
+    if (!in_set(glyphs, c)) { continue; }
+    if (TTF_GlyphMetrics(ttf, c, &minx, &maxx, &miny, &maxy, &advance) < 0) { continue; }
+    /* the glyph sits on the pen at the top of the line, as in a string */
+    s = TTF_RenderGlyph_Blended(ttf, c, white);
+    if (!s) { continue; }
+    coverage = malloc(s->w * s->h);
+    if (coverage && SDL_LockSurface(s) == 0) {
+      for (int y = 0; y < s->h; y++) {
+        const Uint32 *row = (const Uint32*) ((const char*) s->pixels + y * s->pitch);
+        for (int x = 0; x < s->w; x++) { coverage[y * s->w + x] = row[x] >> 24; } /* ARGB8888 */
+      }
+      SDL_UnlockSurface(s);
+      ok = sdf_add_glyph(font, c, coverage, s->w, s->h, s->w, 0, 0, advance);
+    }
+    free(coverage);
+    SDL_FreeSurface(s);
+  }
+  if (ok) { load_kerning(font, ttf, glyphs); }
+  TTF_CloseFont(ttf);
+  if (!ok) { sdf_free(font); return 0; }
+  sdf_end(font);
+  return 1;
+}
+
+static int write_at(FILE *fp, long offset, const void *data, long size) {
+  return fseek(fp, offset, SEEK_SET) == 0 && fwrite(data, 1, size, fp) == (size_t) size;
+}
+
+/// Writes `count` fonts into one pack, `names[i]` is what sdf_map finds
+/// `fonts[i]` by. Returns 0 on failure.
+int sdf_write_pack(const char *path, const sdf_Font *fonts, const char **names, int count) {
+  PackHeader header = { { 'M', 'U', 'F', 'P' }, SDF_PACK_VERSION, count };
+  long at = sizeof(header) + count * sizeof(PackEntry);
+  int ok;
+  FILE *fp = fopen(path, "wb");
+  if (!fp) { return 0; }
+  ok = write_at(fp, 0, &header, sizeof(header));
+  for (int i = 0; ok && i < count; i++) {
+    const sdf_Font *f = &fonts[i];
+    PackEntry e;
+    long kern_bytes = f->kern_count * (long) sizeof(sdf_Kern);
+    memset(&e, 0, sizeof(e));
+    strncpy(e.name, names[i], SDF_PACK_NAME - 1);
+    e.size = f->size;
+    e.height = f->height;
+    e.atlas_w = f->atlas_w;
+    e.atlas_h = f->atlas_h;
+    e.kern_count = f->kern_count;
+    e.glyphs = at;
+    e.kerning = e.glyphs + sizeof(f->glyphs);
+    e.atlas = (e.kerning + kern_bytes + 3) & ~3;
+    at = (e.atlas + (long) f->atlas_w * f->atlas_h + 3) & ~3;
+    ok = write_at(fp, sizeof(header) + i * sizeof(PackEntry), &e, sizeof(e))
+      && write_at(fp, e.glyphs, f->glyphs, sizeof(f->glyphs))
+      && (!kern_bytes || write_at(fp, e.kerning, f->kerning, kern_bytes))
+      && write_at(fp, e.atlas, f->atlas, (long) f->atlas_w * f->atlas_h);
+  }
+  return fclose(fp) == 0 && ok;
+}
+
+#ifdef _WIN32
+static void *map_file(const char *path, long *size) {
+  FILE *fp = fopen(path, "rb");
+  void *data = NULL;
+  if (!fp) { return NULL; }
+  if (fseek(fp, 0, SEEK_END) == 0 && (*size = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0) {
+    data = malloc(*size);
+    if (data && fread(data, 1, *size, fp) != (size_t) *size) { free(data); data = NULL; }
+  }
+  fclose(fp);
+  return data;
+}
+
+static void unmap_file(void *data, long size) {
+  (void) size;
+  free(data);
+}
+#else
+static void *map_file(const char *path, long *size) {
+  struct stat st;
+  void *data;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) { return NULL; }
+  if (fstat(fd, &st) < 0 || st.st_size <= 0) { close(fd); return NULL; }
+  *size = st.st_size;
+  data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  return data == MAP_FAILED ? NULL : data;
+}
+
+static void unmap_file(void *data, long size) {
+  munmap(data, size);
+}
+#endif
+
+static int in_pack(long size, long offset, long bytes) {
+  return offset >= 0 && bytes >= 0 && offset <= size - bytes;
+}
+
+/* glyph rects within the atlas and kerning pairs of glyphs there are, so a
+ * corrupt pack cannot make sampling read outside the mapping */
+static int valid_glyphs(const sdf_Glyph *glyphs, const sdf_Kern *kerning, int kern_count, int atlas_w, int atlas_h) {
+  for (int i = 0; i < SDF_GLYPHS; i++) {
+    const sdf_Glyph *g = &glyphs[i];
+    if (g->x < 0 || g->y < 0 || g->w < 0 || g->h < 0 || g->x + g->w > atlas_w || g->y + g->h > atlas_h) { return 0; }
+  }
+  for (int i = 0; i < kern_count; i++) {
+    if (kerning[i].left >= SDF_GLYPHS || kerning[i].right >= SDF_GLYPHS) { return 0; }
+  }
+  return 1;
+}
+
+/// Points `font` at the font called `name` in a pack written by
+/// sdf_write_pack, the first one when `name` is NULL. The atlas stays in the
+/// mapping and must not be written to. Returns 0 when the pack cannot be
+/// read, has another version, holds no such font, or any of its sections,
+/// glyph rects or kerning pairs lies outside what it was written with.
+int sdf_map(sdf_Font *font, const char *path, const char *name) {
+  long size = 0;
+  char *pack = map_file(path, &size);
+  const PackHeader *header = (const PackHeader*) pack;
+  sdf_Glyph glyphs[SDF_GLYPHS];
+  if (!pack) { return 0; }
+  if (size >= (long) sizeof(*header) && !memcmp(header->magic, "MUFP", 4) && header->version == SDF_PACK_VERSION
+      && header->count >= 0 && in_pack(size, sizeof(*header), header->count * (long) sizeof(PackEntry))) {
+    const PackEntry *entries = (const PackEntry*) (pack + sizeof(*header));
+    for (int i = 0; i < header->count; i++) {
+      const PackEntry *e = &entries[i];
+      if (name && strncmp(e->name, name, SDF_PACK_NAME)) { continue; }
+      if (!in_pack(size, e->glyphs, sizeof(font->glyphs)) || e->atlas_w <= 0 || e->atlas_h <= 0
+          || !in_pack(size, e->kerning, e->kern_count * (long) sizeof(sdf_Kern))
+          || !in_pack(size, e->atlas, (long) e->atlas_w * e->atlas_h)) { break; }
+      memcpy(glyphs, pack + e->glyphs, sizeof(glyphs));
+      if (!valid_glyphs(glyphs, (const sdf_Kern*) (pack + e->kerning), e->kern_count, e->atlas_w, e->atlas_h)) { break; }
+      memset(font, 0, sizeof(*font));
+      font->size = e->size;
+      font->height = e->height;
+      font->atlas_w = e->atlas_w;
+      font->atlas_h = e->atlas_h;
+      font->atlas = (unsigned char*) pack + e->atlas;
+      memcpy(font->glyphs, glyphs, sizeof(font->glyphs));
+      font->kerning = (const sdf_Kern*) (pack + e->kerning);
+      font->kern_count = e->kern_count;
+      font->mapping = pack;
+      font->mapping_size = size;
+      SDL_AtomicSet(&font->ready, 1);
+      return 1;
+    }
+  }
+  unmap_file(pack, size);
+  return 0;
+}
+
+void sdf_free(sdf_Font *font) {
+  SDL_AtomicSet(&font->ready, 0);
+  if (font->mapping) {
+    unmap_file(font->mapping, font->mapping_size);
+  } else {
+    free(font->atlas);
+    free((void*) font->kerning);
+  }
+  font->atlas = NULL;
+  font->kerning = NULL;
+  font->mapping = NULL;
+}
+
+/// Whether the atlas and glyphs are complete: a font being loaded on another
+/// thread is not drawn from until sdf_end or sdf_map published it.
+int sdf_ready(const sdf_Font *font) {
+  return SDL_AtomicGet((SDL_atomic_t*) &font->ready);
+}
+
+/// Returns the face drawing `font` at `size` pixels and `weight`, the same
+/// pointer for the same arguments so text caches keyed on the font still
+/// hit. NULL once SDF_MAX_FACES distinct faces exist.
+sdf_Face *sdf_face(sdf_Font *font, float size, float weight) {
+  for (int i = 0; i < face_count; i++) {
+    sdf_Face *f = &faces[i];
+    if (f->font == font && f->size == size && f->weight == weight) { return f; }
+  }
+  if (face_count == SDF_MAX_FACES) { return NULL; }
+  faces[face_count] = (sdf_Face){ font, size, weight };
+  return &faces[face_count++];
+}
+
+/* renderers tell faces from their own font handles by address */
+int sdf_is_face(const void *font) {
+  uintptr_t p = (uintptr_t) font;
+  return p >= (uintptr_t) faces && p < (uintptr_t) (faces + SDF_MAX_FACES);
+}
+
+/// Decodes one UTF-8 character at `*text` and advances past it. Characters
+/// the atlas has no glyph for, including those left out when baking, are '?'.
+const sdf_Glyph *sdf_glyph(const sdf_Font *font, const char **text, const char *end) {
+  int c = (unsigned char) *(*text)++;
+  while (*text < end && (**text & 0xc0) == 0x80) { (*text)++; c = '?'; }
+  if (c < SDF_FIRST_GLYPH || c >= SDF_FIRST_GLYPH + SDF_GLYPHS) { c = '?'; }
+  if (!font->glyphs[c - SDF_FIRST_GLYPH].advance && c != ' ') { c = '?'; } /* not baked, in_set keeps '?' */
+  return &font->glyphs[c - SDF_FIRST_GLYPH];
+}
+
+/* extra advance between two glyphs, 0 after the first */
+int sdf_kerning(const sdf_Font *font, const sdf_Glyph *left, const sdf_Glyph *right) {
+  int l, r, lo = 0, hi = font->kern_count;
+  if (!left || !hi) { return 0; }
+  l = (int) (left - font->glyphs);
+  r = (int) (right - font->glyphs);
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    const sdf_Kern *k = &font->kerning[mid];
+    if (k->left == l && k->right == r) { return k->amount; }
+    if (k->left < l || (k->left == l && k->right < r)) { lo = mid + 1; } else { hi = mid; }
+  }
+  return 0;
+}
+
+float sdf_text_width(const sdf_Face *face, const char *text, int len) {
+  float scale = face->size / face->font->size;
+  const sdf_Glyph *prev = NULL;
+  int advance = 0;
+  for (const char *p = text, *end = text + len; p < end; ) {
+    const sdf_Glyph *g = sdf_glyph(face->font, &p, end);
+    advance += sdf_kerning(face->font, prev, g) + g->advance;
+    prev = g;
+  }
+  return advance * scale;
+}
+
+int sdf_line_height(const sdf_Face *face) {
+  return (int) (face->font->height * face->size / face->font->size + 0.5f);
+}
+
+/* the atlas value of the outline the face is drawn at */
+unsigned char sdf_threshold(const sdf_Face *face) {
+  int t = 128 - (int) (face->weight * 127 / SDF_SPREAD);
+  return t < 1 ? 1 : t > 254 ? 254 : t;
+}
+
+/* atlas values across one pixel at the face's size, the width of the
+ * antialiased ramp */
+float sdf_softness(const sdf_Face *face) {
+  return face->font->size / face->size * 127.0f / SDF_SPREAD;
+}
+
+static int sample(const sdf_Font *font, const sdf_Glyph *g, float u, float v) {
+  /* bilinear within the glyph's rect, in 1/256 steps */
+  int x, y, fx, fy, x1, y1;
+  const unsigned char *a = font->atlas;
+  u -= 0.5f; v -= 0.5f;
+  if (u < 0) { u = 0; }
+  if (v < 0) { v = 0; }
+  x = (int) u; y = (int) v;
+  fx = (int) ((u - x) * 256); fy = (int) ((v - y) * 256);
+  if (x > g->w - 1) { x = g->w - 1; fx = 0; }
+  if (y > g->h - 1) { y = g->h - 1; fy = 0; }
+  x1 = x + 1 < g->w ? x + 1 : x;
+  y1 = y + 1 < g->h ? y + 1 : y;
+  x += g->x; x1 += g->x;
+  y = (g->y + y) * font->atlas_w; y1 = (g->y + y1) * font->atlas_w;
+  {
+    int top = a[y + x] * (256 - fx) + a[y + x1] * fx;
+    int bottom = a[y1 + x] * (256 - fx) + a[y1 + x1] * fx;
+    return (top * (256 - fy) + bottom * fy) >> 16;
+  }
+}
+
+/// Software kernel of the distance-field text path: draws `text` as coverage
+/// into `dst`, `w` x `h` bytes with the line's top left at 0,0. `dst` is
+/// cleared first; glyphs that overlap keep the larger coverage.
+void sdf_render(const sdf_Face *face, const char *text, int len, unsigned char *dst, int w, int h) {
+  const sdf_Font *font = face->font;
+  float scale = face->size / font->size, pen = 0;
+  float threshold = sdf_threshold(face), softness = sdf_softness(face);
+  const sdf_Glyph *prev = NULL;
+  memset(dst, 0, w * h);
+  for (const char *p = text, *end = text + len; p < end; ) {
+    const sdf_Glyph *g = sdf_glyph(font, &p, end);
+    pen += sdf_kerning(font, prev, g) * scale;
+    prev = g;
+    float gx = pen + g->left * scale, gy = g->top * scale;
+    int x0 = gx > 0 ? (int) gx : 0, y0 = gy > 0 ? (int) gy : 0;
+    int x1 = (int) (gx + g->w * scale) + 1, y1 = (int) (gy + g->h * scale) + 1;
+    pen += g->advance * scale;
+    if (!g->w) { continue; }
+    if (x1 > w) { x1 = w; }
+    if (y1 > h) { y1 = h; }
+    for (int y = y0; y < y1; y++) {
+      float v = (y + 0.5f - gy) / scale;
+      for (int x = x0; x < x1; x++) {
+        float c = (sample(font, g, (x + 0.5f - gx) / scale, v) - threshold) / softness + 0.5f;
+        int a = c <= 0 ? 0 : c >= 1 ? 255 : (int) (c * 255);
+        if (a > dst[y * w + x]) { dst[y * w + x] = a; }
+      }
+    }
+  }
+}
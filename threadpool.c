@@ -0,0 +1,120 @@
+#include <SDL2/SDL.h>
+#include "threadpool.h"
+
+/* Small fixed thread pool backing mu_Context.parallel_for. The calling thread
+ * takes part in every batch, so tp_init(n) starts n - 1 workers. Batches must
+ * not be nested.
+ *
+ * Each batch is split into one contiguous index range per participant. A
+ * participant works through its own range from the front; once it runs dry it
+ * steals the back half of the fullest other range, so an uneven split (one
+ * deep subtree next to many shallow ones) still keeps every thread busy. */
+
+typedef struct {
+  SDL_SpinLock lock;
+  int begin, end;
+} tp_Range;
+
+static SDL_Thread *workers[TP_MAX_THREADS];
+static int worker_count;
+static SDL_sem *start_sem;
+static SDL_sem *done_sem;
+static SDL_atomic_t quit;
+
+static tp_Range ranges[TP_MAX_THREADS];
+static tp_Task batch_task;
+static void *batch_data;
+
+static int pop_own(tp_Range *r, int *index) {
+  int ok = 0;
+  SDL_AtomicLock(&r->lock);
+  if (r->begin < r->end) { *index = r->begin++; ok = 1; }
+  SDL_AtomicUnlock(&r->lock);
+  return ok;
+}
+
+/* moves the back half of the fullest other range into ranges[self] */
+static int steal(int self) {
+  int victim = -1, best = 0;
+  for (int i = 0; i <= worker_count; i++) {
+    int left;
+    if (i == self) { continue; }
+    SDL_AtomicLock(&ranges[i].lock);
+    left = ranges[i].end - ranges[i].begin;
+    SDL_AtomicUnlock(&ranges[i].lock);
+    if (left > best) { best = left; victim = i; }
+  }
+  if (victim < 0) { return 0; }
+  tp_Range *v = &ranges[victim];
+  int begin = 0, end = 0;
+  SDL_AtomicLock(&v->lock);
+  if (v->begin < v->end) {
+    end = v->end;
+    begin = v->end - (v->end - v->begin + 1) / 2;
+    v->end = begin;
+  }
+  SDL_AtomicUnlock(&v->lock);
+  if (begin == end) { return 1; } /* lost the race, look again */
+  SDL_AtomicLock(&ranges[self].lock);
+  ranges[self].begin = begin;
+  ranges[self].end = end;
+  SDL_AtomicUnlock(&ranges[self].lock);
+  return 1;
+}
+
+static void run_batch(int self) {
+  int i;
+  for (;;) {
+    while (pop_own(&ranges[self], &i)) { batch_task(batch_data, i); }
+    if (!steal(self)) { break; }
+  }
+}
+
+static int worker_main(void *arg) {
+  int self = (int)(intptr_t)arg;
+  for (;;) {
+    SDL_SemWait(start_sem);
+    if (SDL_AtomicGet(&quit)) { break; }
+    run_batch(self);
+    SDL_SemPost(done_sem);
+  }
+  return 0;
+}
+
+void tp_init(int threads) {
+  if (threads > TP_MAX_THREADS) { threads = TP_MAX_THREADS; }
+  start_sem = SDL_CreateSemaphore(0);
+  done_sem = SDL_CreateSemaphore(0);
+  SDL_AtomicSet(&quit, 0);
+  /* participant 0 is the calling thread */
+  for (worker_count = 0; worker_count < threads - 1; worker_count++) {
+    workers[worker_count] = SDL_CreateThread(worker_main, "worker", (void*)(intptr_t)(worker_count + 1));
+  }
+}
+
+void tp_shutdown(void) {
+  SDL_AtomicSet(&quit, 1);
+  for (int i = 0; i < worker_count; i++) { SDL_SemPost(start_sem); }
+  for (int i = 0; i < worker_count; i++) { SDL_WaitThread(workers[i], NULL); }
+  worker_count = 0;
+  SDL_DestroySemaphore(start_sem);
+  SDL_DestroySemaphore(done_sem);
+}
+
+void tp_parallel_for(tp_Task task, void *data, int count) {
+  int participants = worker_count + 1;
+  if (worker_count == 0 || count < 2) {
+    for (int i = 0; i < count; i++) { task(data, i); }
+    return;
+  }
+  batch_task = task;
+  batch_data = data;
+  for (int i = 0; i < participants; i++) {
+    ranges[i].lock = 0;
+    ranges[i].begin = count * i / participants;
+    ranges[i].end = count * (i + 1) / participants;
+  }
+  for (int i = 0; i < worker_count; i++) { SDL_SemPost(start_sem); }
+  run_batch(0);
+  for (int i = 0; i < worker_count; i++) { SDL_SemWait(done_sem); }
+}
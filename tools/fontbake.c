@@ -0,0 +1,80 @@
+/* fontbake: rasterizes TrueType/OpenType fonts into distance-field atlases
+ * and writes them into one pack for r_load_font_pack, so the application
+ * starts without FreeType.
+ *
+ *   fontbake -o fonts.pack [-s size] [-g glyphs] font.ttf[=name] ...
+ *
+ * -s is the size the atlas is rasterized at (48 by default), -g limits the
+ * atlas to the given characters. A font is found in the pack by its name,
+ * the file name without directory and extension unless given. */
+
+#define SDL_MAIN_HANDLED
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdffont.h"
+
+#define MAX_FONTS 16
+
+static sdf_Font fonts[MAX_FONTS];
+static char names[MAX_FONTS][SDF_PACK_NAME];
+
+static void usage(void) {
+  fprintf(stderr, "usage: fontbake -o out.pack [-s size] [-g glyphs] font.ttf[=name] ...\n");
+  exit(1);
+}
+
+/* "dir/Font-Regular.ttf" -> "Font-Regular" */
+static void default_name(char *name, const char *path) {
+  const char *base = path, *dot;
+  for (const char *p = path; *p; p++) {
+    if (*p == '/' || *p == '\\') { base = p + 1; }
+  }
+  dot = strrchr(base, '.');
+  snprintf(name, SDF_PACK_NAME, "%.*s", dot ? (int) (dot - base) : (int) strlen(base), base);
+}
+
+int main(int argc, char **argv) {
+  const char *out = NULL, *glyphs = NULL, *name_ptrs[MAX_FONTS];
+  int size = 48, count = 0;
+  if (TTF_Init() < 0) {
+    fprintf(stderr, "fontbake: %s\n", TTF_GetError());
+    return 1;
+  }
+  for (int i = 1; i < argc; i++) {
+    char path[1024], *eq;
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) { out = argv[++i]; continue; }
+    if (!strcmp(argv[i], "-s") && i + 1 < argc) { size = atoi(argv[++i]); continue; }
+    if (!strcmp(argv[i], "-g") && i + 1 < argc) { glyphs = argv[++i]; continue; }
+    if (argv[i][0] == '-') { usage(); }
+    if (count == MAX_FONTS) {
+      fprintf(stderr, "fontbake: at most %d fonts per pack\n", MAX_FONTS);
+      return 1;
+    }
+    snprintf(path, sizeof(path), "%s", argv[i]);
+    if ((eq = strrchr(path, '='))) {
+      *eq = '\0';
+      snprintf(names[count], SDF_PACK_NAME, "%s", eq + 1);
+    } else {
+      default_name(names[count], path);
+    }
+    if (!sdf_load(&fonts[count], path, size, glyphs)) {
+      fprintf(stderr, "fontbake: cannot bake %s\n", path);
+      return 1;
+    }
+    printf("%s: %d px, atlas %dx%d, %d kerning pairs\n", names[count], size,
+           fonts[count].atlas_w, fonts[count].atlas_h, fonts[count].kern_count);
+    name_ptrs[count] = names[count];
+    count++;
+  }
+  if (!out || !count || size <= 0) { usage(); }
+  if (!sdf_write_pack(out, fonts, name_ptrs, count)) {
+    fprintf(stderr, "fontbake: cannot write %s\n", out);
+    return 1;
+  }
+  for (int i = 0; i < count; i++) { sdf_free(&fonts[i]); }
+  TTF_Quit();
+  return 0;
+}
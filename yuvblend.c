@@ -0,0 +1,779 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "yuvblend.h"
+#include "sdffont.h"
+#include "images.h"
+#include "atlas.inl"
+
+#if defined(__SSE2__)
+#define YUV_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define YUV_NEON
+#include <arm_neon.h>
+#endif
+
+/* Blends the UI straight into the YUV 4:2:0 frames of a camera, instead of
+ * reading RGBA back from the GPU and converting whole frames. Two sources:
+ *
+ * yuv_draw_commands rasterizes a frame's command list. Each command's color
+ * is converted once, and rects, boxes, icons, text and images only touch the
+ * pixels they cover. Text needs a distance-field face that is ready, any other
+ * font is drawn with the built-in atlas font.
+ *
+ * yuv_blend_layer blends a premultiplied RGBA image of the UI, e.g. one the
+ * GPU rendered only when the UI changed. The layer remembers which tiles have
+ * coverage, yuv_layer_damage updates that for redrawn regions, and blending
+ * skips the empty tiles.
+ *
+ * Chroma samples take the share of their 2x2 pixels a draw covers. The row
+ * kernels have SSE2 and NEON versions, the scalar loops do the same integer
+ * math for the remaining pixels and other targets. Alphas are scaled to
+ * 0..256 with a + (a >> 7), so opaque replaces and blends end in a shift. */
+
+#define CLIP_STACK_SIZE 32
+
+typedef struct { int y, u, v, a; } Yuva;
+
+/* rows of the RGB to limited range YCbCr matrices in 8-bit fixed point, luma
+ * sums to 220 and either chroma row to 0 */
+static const int matrices[2][3][3] = {
+  { { 66, 129,  25 }, { -38, -74, 112 }, { 112,  -94, -18 } }, /* BT.601 */
+  { { 47, 157,  16 }, { -26, -87, 113 }, { 112, -102, -10 } }  /* BT.709 */
+};
+
+static unsigned char *scratch; /* coverage of a string, scaled image pixels */
+static size_t scratch_size;
+
+/* images are drawn from copies at the size they were first drawn at, kept
+ * within image_budget bytes and evicted least recently drawn first. An image
+ * is held (images.c) only until its copy is made, so a renderer drawing the
+ * same image shares the decode and the pixels are freed after both. */
+typedef struct {
+  unsigned char *pixels; /* w * h premultiplied RGBA, NULL without a copy */
+  int w, h;
+  int src_w, src_h; /* of the decoded image */
+  int last_used; /* yuv_draw_commands call */
+  int held; /* the decoded pixels, until the copy is made */
+} ImageCopy;
+
+static ImageCopy copies[IMG_MAX_IMAGES];
+static img_Image *holding[IMG_MAX_IMAGES]; /* images with held set */
+static int holding_count;
+static long copy_bytes;
+static long image_budget = YUV_IMAGE_BUDGET;
+static int draw_count; /* yuv_draw_commands calls */
+
+static const int (*matrix(const yuv_Frame *f))[3] {
+  return matrices[f->matrix == YUV_BT709];
+}
+
+static Yuva convert(const yuv_Frame *f, mu_Color c) {
+  const int (*m)[3] = matrix(f);
+  Yuva p;
+  p.y = (m[0][0] * c.r + m[0][1] * c.g + m[0][2] * c.b + (16 << 8) + 128) >> 8;
+  p.u = (m[1][0] * c.r + m[1][1] * c.g + m[1][2] * c.b + (128 << 8) + 128) >> 8;
+  p.v = (m[2][0] * c.r + m[2][1] * c.g + m[2][2] * c.b + (128 << 8) + 128) >> 8;
+  p.a = c.a;
+  return p;
+}
+
+static unsigned char *grow_scratch(size_t size) {
+  if (size > scratch_size) {
+    unsigned char *p = realloc(scratch, size);
+    if (!p) { return NULL; }
+    scratch = p;
+    scratch_size = size;
+  }
+  return scratch;
+}
+
+static mu_Rect intersect_rects(mu_Rect a, mu_Rect b) {
+  int x1 = mu_max(a.x, b.x);
+  int y1 = mu_max(a.y, b.y);
+  int x2 = mu_min(a.x + a.w, b.x + b.w);
+  int y2 = mu_min(a.y + a.h, b.y + b.h);
+  if (x2 < x1) { x2 = x1; }
+  if (y2 < y1) { y2 = y1; }
+  return mu_rect(x1, y1, x2 - x1, y2 - y1);
+}
+
+static unsigned char *chroma_u(const yuv_Frame *f, int cx, int cy) {
+  if (f->format == YUV_NV12) { return f->u + cy * f->uv_stride + 2 * cx; }
+  return f->u + cy * f->uv_stride + cx;
+}
+
+static unsigned char *chroma_v(const yuv_Frame *f, int cx, int cy) {
+  if (f->format == YUV_NV12) { return f->u + cy * f->uv_stride + 2 * cx + 1; }
+  return f->v + cy * f->uv_stride + cx;
+}
+
+static int clamp_byte(int x) {
+  return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+#if defined(YUV_SSE2)
+/* two 16-bit lanes of a 32-bit one, for _mm_madd_epi16 */
+static int pair16(int lo, int hi) {
+  return (int)(((unsigned)lo & 0xffff) | (unsigned)hi << 16);
+}
+#endif
+
+
+/* ---- constant color ---- */
+
+/* dst = (dst * inv + k) >> 8 over n bytes, k0 for even and k1 for odd bytes
+ * so an interleaved CbCr row takes both; inv is at most 255 */
+static void blend_const_row(unsigned char *dst, int n, int inv, int k0, int k1) {
+  int i = 0;
+#if defined(YUV_SSE2)
+  __m128i zero = _mm_setzero_si128(), vinv = _mm_set1_epi16((short)inv);
+  __m128i vk = _mm_set1_epi32((int)((unsigned)k0 | (unsigned)k1 << 16));
+  for (; i + 16 <= n; i += 16) {
+    __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), vinv), vk);
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), vinv), vk);
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+  }
+#elif defined(YUV_NEON)
+  uint8x8_t vinv = vdup_n_u8((uint8_t)inv);
+  uint16x8_t vk = vreinterpretq_u16_u32(vdupq_n_u32((uint32_t)k0 | (uint32_t)k1 << 16));
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t d = vld1q_u8(dst + i);
+    uint16x8_t lo = vmlal_u8(vk, vget_low_u8(d), vinv);
+    uint16x8_t hi = vmlal_u8(vk, vget_high_u8(d), vinv);
+    vst1q_u8(dst + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+  }
+#endif
+  for (; i < n; i++) { dst[i] = (dst[i] * inv + (i & 1 ? k1 : k0)) >> 8; }
+}
+
+/* one chroma sample, a in 0..256 */
+static void blend_chroma(const yuv_Frame *f, int cx, int cy, int a, int u, int v) {
+  unsigned char *pu = chroma_u(f, cx, cy), *pv = chroma_v(f, cx, cy);
+  *pu = (*pu * (256 - a) + u * a + 128) >> 8;
+  *pv = (*pv * (256 - a) + v * a + 128) >> 8;
+}
+
+/* chroma samples [cx0, cx1) of row cy, a in 1..256 */
+static void blend_chroma_run(const yuv_Frame *f, int cx0, int cx1, int cy, int a, Yuva c) {
+  if (cx1 <= cx0) { return; }
+  if (f->format == YUV_NV12) {
+    blend_const_row(chroma_u(f, cx0, cy), 2 * (cx1 - cx0), 256 - a, c.u * a + 128, c.v * a + 128);
+  } else {
+    blend_const_row(chroma_u(f, cx0, cy), cx1 - cx0, 256 - a, c.u * a + 128, c.u * a + 128);
+    blend_const_row(chroma_v(f, cx0, cy), cx1 - cx0, 256 - a, c.v * a + 128, c.v * a + 128);
+  }
+}
+
+/* a solid rect, already clipped */
+static void blend_rect(const yuv_Frame *f, mu_Rect r, Yuva c) {
+  int a = c.a + (c.a >> 7), x1 = r.x + r.w, y1 = r.y + r.h;
+  if (!c.a || r.w <= 0 || r.h <= 0) { return; }
+  for (int y = r.y; y < y1; y++) {
+    blend_const_row(f->y + y * f->y_stride + r.x, r.w, 256 - a, c.y * a + 128, c.y * a + 128);
+  }
+  for (int cy = r.y >> 1; cy < (y1 + 1) >> 1; cy++) {
+    int rows = mu_min(2 * cy + 2, y1) - mu_max(2 * cy, r.y); /* 1 or 2 */
+    int inner = (r.x + 1) >> 1, outer = x1 >> 1; /* samples covered by two columns */
+    int ca = (a * rows * 2) >> 2;
+    if (r.x & 1) { blend_chroma(f, r.x >> 1, cy, (a * rows) >> 2, c.u, c.v); }
+    if (ca) { blend_chroma_run(f, inner, outer, cy, ca, c); }
+    if (x1 & 1) { blend_chroma(f, x1 >> 1, cy, (a * rows) >> 2, c.u, c.v); }
+  }
+}
+
+
+/* ---- coverage masks: text and icons ---- */
+
+/* dst blended towards value by mask * a / 256 per pixel, a in 1..256 */
+static void blend_mask_row(unsigned char *dst, const unsigned char *mask, int n, int value, int a) {
+  int i = 0;
+#if defined(YUV_SSE2)
+  __m128i zero = _mm_setzero_si128(), va = _mm_set1_epi16((short)a);
+  __m128i v256 = _mm_set1_epi16(256), vvalue = _mm_set1_epi16((short)value), v128 = _mm_set1_epi16(128);
+  for (; i + 16 <= n; i += 16) {
+    __m128i m = _mm_loadu_si128((const __m128i*)(mask + i));
+    __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+    __m128i half[2];
+    for (int h = 0; h < 2; h++) {
+      __m128i mh = h ? _mm_unpackhi_epi8(m, zero) : _mm_unpacklo_epi8(m, zero);
+      __m128i dh = h ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+      __m128i ma = _mm_srli_epi16(_mm_mullo_epi16(mh, va), 8);
+      ma = _mm_add_epi16(ma, _mm_srli_epi16(ma, 7));
+      dh = _mm_add_epi16(_mm_mullo_epi16(dh, _mm_sub_epi16(v256, ma)), _mm_mullo_epi16(vvalue, ma));
+      half[h] = _mm_srli_epi16(_mm_add_epi16(dh, v128), 8);
+    }
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(half[0], half[1]));
+  }
+#elif defined(YUV_NEON)
+  uint16x8_t va = vdupq_n_u16((uint16_t)a), v256 = vdupq_n_u16(256), vvalue = vdupq_n_u16((uint16_t)value);
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t m = vld1q_u8(mask + i), d = vld1q_u8(dst + i);
+    uint8x8_t half[2];
+    for (int h = 0; h < 2; h++) {
+      uint16x8_t ma = vshrq_n_u16(vmulq_u16(vmovl_u8(h ? vget_high_u8(m) : vget_low_u8(m)), va), 8);
+      ma = vsraq_n_u16(ma, ma, 7);
+      uint16x8_t t = vmulq_u16(vmovl_u8(h ? vget_high_u8(d) : vget_low_u8(d)), vsubq_u16(v256, ma));
+      half[h] = vrshrn_n_u16(vmlaq_u16(t, vvalue, ma), 8);
+    }
+    vst1q_u8(dst + i, vcombine_u8(half[0], half[1]));
+  }
+#endif
+  for (; i < n; i++) {
+    int ma = (mask[i] * a) >> 8;
+    ma += ma >> 7;
+    dst[i] = (dst[i] * (256 - ma) + value * ma + 128) >> 8;
+  }
+}
+
+/* color through a w * h coverage mask at (x, y), inside clip */
+static void blend_mask(const yuv_Frame *f, mu_Rect clip, int x, int y, const unsigned char *mask, int w, int h, int pitch, Yuva c) {
+  mu_Rect r = intersect_rects(mu_rect(x, y, w, h), clip);
+  int a = c.a + (c.a >> 7), x1 = r.x + r.w, y1 = r.y + r.h;
+  if (!c.a || r.w <= 0 || r.h <= 0) { return; }
+  for (int py = r.y; py < y1; py++) {
+    blend_mask_row(f->y + py * f->y_stride + r.x, mask + (py - y) * pitch + (r.x - x), r.w, c.y, a);
+  }
+  for (int cy = r.y >> 1; cy < (y1 + 1) >> 1; cy++) {
+    for (int cx = r.x >> 1; cx < (x1 + 1) >> 1; cx++) {
+      int sum = 0, ca;
+      for (int py = mu_max(2 * cy, r.y); py < mu_min(2 * cy + 2, y1); py++) {
+        for (int px = mu_max(2 * cx, r.x); px < mu_min(2 * cx + 2, x1); px++) {
+          sum += mask[(py - y) * pitch + (px - x)];
+        }
+      }
+      ca = (sum * a) >> 10;
+      if (ca) { blend_chroma(f, cx, cy, ca + (ca >> 7), c.u, c.v); }
+    }
+  }
+}
+
+
+/* ---- premultiplied RGBA: layers and images ---- */
+
+/* luma of n pixels; rgb must not exceed alpha */
+static void blend_rgba_luma(unsigned char *dst, const unsigned char *p, int n, const int *m) {
+  int i = 0;
+#if defined(YUV_SSE2)
+  __m128i zero = _mm_setzero_si128(), lo8 = _mm_set1_epi32(0x00ff00ff), v255 = _mm_set1_epi16(255);
+  __m128i crb = _mm_set1_epi32(pair16(m[0], m[2])), cga = _mm_set1_epi32(pair16(m[1], 16));
+  __m128i bias = _mm_set1_epi32(128 - 32768), sign = _mm_set1_epi16((short)0x8000), v256 = _mm_set1_epi16(256);
+  for (; i + 8 <= n; i += 8) {
+    __m128i p0 = _mm_loadu_si128((const __m128i*)(p + 4 * i));
+    __m128i p1 = _mm_loadu_si128((const __m128i*)(p + 4 * i + 16));
+    __m128i a = _mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24));
+    __m128i s0, s1, s;
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(a, zero)) == 0xffff) { continue; }
+    /* R | B << 16 and G | A << 16 per pixel, one madd each */
+    s0 = _mm_add_epi32(_mm_madd_epi16(_mm_and_si128(p0, lo8), crb), _mm_madd_epi16(_mm_and_si128(_mm_srli_epi32(p0, 8), lo8), cga));
+    s1 = _mm_add_epi32(_mm_madd_epi16(_mm_and_si128(p1, lo8), crb), _mm_madd_epi16(_mm_and_si128(_mm_srli_epi32(p1, 8), lo8), cga));
+    /* to unsigned 16-bit lanes through a signed pack */
+    s = _mm_xor_si128(_mm_packs_epi32(_mm_add_epi32(s0, bias), _mm_add_epi32(s1, bias)), sign);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(a, v255)) != 0xffff) {
+      __m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(dst + i)), zero);
+      a = _mm_add_epi16(a, _mm_srli_epi16(a, 7));
+      s = _mm_adds_epu16(_mm_mullo_epi16(d, _mm_sub_epi16(v256, a)), s);
+    }
+    s = _mm_srli_epi16(s, 8);
+    _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(s, s));
+  }
+#elif defined(YUV_NEON)
+  uint8x8_t cr = vdup_n_u8((uint8_t)m[0]), cg = vdup_n_u8((uint8_t)m[1]), cb = vdup_n_u8((uint8_t)m[2]), c16 = vdup_n_u8(16);
+  uint16x8_t v256 = vdupq_n_u16(256), v128 = vdupq_n_u16(128);
+  for (; i + 16 <= n; i += 16) {
+    uint8x16x4_t q = vld4q_u8(p + 4 * i);
+    uint8x16_t d;
+    uint8x8_t half[2];
+    uint8x8_t any = vorr_u8(vget_low_u8(q.val[3]), vget_high_u8(q.val[3]));
+    if (vget_lane_u64(vreinterpret_u64_u8(any), 0) == 0) { continue; }
+    d = vld1q_u8(dst + i);
+    for (int h = 0; h < 2; h++) {
+      uint8x8_t r = h ? vget_high_u8(q.val[0]) : vget_low_u8(q.val[0]);
+      uint8x8_t g = h ? vget_high_u8(q.val[1]) : vget_low_u8(q.val[1]);
+      uint8x8_t b = h ? vget_high_u8(q.val[2]) : vget_low_u8(q.val[2]);
+      uint8x8_t a8 = h ? vget_high_u8(q.val[3]) : vget_low_u8(q.val[3]);
+      uint16x8_t s = vmlal_u8(vmlal_u8(vmlal_u8(vmlal_u8(v128, r, cr), g, cg), b, cb), a8, c16);
+      uint16x8_t a = vmovl_u8(a8);
+      a = vsraq_n_u16(a, a, 7);
+      s = vqaddq_u16(vmulq_u16(vmovl_u8(h ? vget_high_u8(d) : vget_low_u8(d)), vsubq_u16(v256, a)), s);
+      half[h] = vshrn_n_u16(s, 8);
+    }
+    vst1q_u8(dst + i, vcombine_u8(half[0], half[1]));
+  }
+#endif
+  for (; i < n; i++) {
+    const unsigned char *q = p + 4 * i;
+    int a = q[3] + (q[3] >> 7);
+    int s = m[0] * q[0] + m[1] * q[1] + m[2] * q[2] + 16 * q[3] + 128;
+    dst[i] = clamp_byte((dst[i] * (256 - a) + s) >> 8);
+  }
+}
+
+/* chroma from the channel sums of up to four pixels */
+static void blend_chroma_sums(unsigned char *u, unsigned char *v, int r, int g, int b, int a4, const int (*m)[3]) {
+  int a = (a4 + 2) >> 2;
+  int su = m[1][0] * r + m[1][1] * g + m[1][2] * b + 128 * a4 + 512;
+  int sv = m[2][0] * r + m[2][1] * g + m[2][2] * b + 128 * a4 + 512;
+  a += a >> 7;
+  su += 4 * *u * (256 - a);
+  sv += 4 * *v * (256 - a);
+  *u = clamp_byte(su < 0 ? 0 : su >> 10);
+  *v = clamp_byte(sv < 0 ? 0 : sv >> 10);
+}
+
+/* the sample over `columns` pixels (1 or 2) of rows p0 and p1, NULL for a
+ * row outside the draw */
+static void blend_rgba_block(const yuv_Frame *f, int cx, int cy, const unsigned char *p0, const unsigned char *p1, int columns, const int (*m)[3]) {
+  int s[4] = { 0, 0, 0, 0 };
+  for (int k = 0; k < 4 * columns; k++) {
+    s[k & 3] += (p0 ? p0[k] : 0) + (p1 ? p1[k] : 0);
+  }
+  if (s[3]) { blend_chroma_sums(chroma_u(f, cx, cy), chroma_v(f, cx, cy), s[0], s[1], s[2], s[3], m); }
+}
+
+/* n samples from cx on, each over two pixels of both rows */
+static void blend_rgba_chroma(const yuv_Frame *f, int cx, int cy, const unsigned char *p0, const unsigned char *p1, int n, const int (*m)[3]) {
+  int i = 0;
+#if defined(YUV_SSE2)
+  __m128i zero = _mm_setzero_si128(), lo8 = _mm_set1_epi32(0x00ff00ff), lo16 = _mm_set1_epi32(0xffff);
+  __m128i alpha = _mm_set1_epi32((int)0xff000000u), opaque = _mm_set1_epi32(4 * 255);
+  __m128i cu_rb = _mm_set1_epi32(pair16(m[1][0], m[1][2])), cu_ga = _mm_set1_epi32(pair16(m[1][1], 128));
+  __m128i cv_rb = _mm_set1_epi32(pair16(m[2][0], m[2][2])), cv_ga = _mm_set1_epi32(pair16(m[2][1], 128));
+  __m128i v2 = _mm_set1_epi32(2), v256 = _mm_set1_epi32(256), v512 = _mm_set1_epi32(512);
+  for (; i + 4 <= n; i += 4) {
+    __m128i q[4], rb[2], ga[2], su, sv, a4, du, dv;
+    for (int k = 0; k < 4; k++) { q[k] = _mm_loadu_si128((const __m128i*)((k & 1 ? p1 : p0) + 8 * i + 16 * (k >> 1))); }
+    du = _mm_or_si128(_mm_or_si128(q[0], q[1]), _mm_or_si128(q[2], q[3]));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(du, alpha), zero)) == 0xffff) { continue; }
+    /* both rows added per pixel: R | B << 16 and G | A << 16 */
+    for (int h = 0; h < 2; h++) {
+      rb[h] = _mm_add_epi16(_mm_and_si128(q[2 * h], lo8), _mm_and_si128(q[2 * h + 1], lo8));
+      ga[h] = _mm_add_epi16(_mm_and_si128(_mm_srli_epi32(q[2 * h], 8), lo8), _mm_and_si128(_mm_srli_epi32(q[2 * h + 1], 8), lo8));
+    }
+    /* and the even pixel of each sample to the odd one */
+#define PAIRS(v) _mm_add_epi16(_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(v[0]), _mm_castsi128_ps(v[1]), _MM_SHUFFLE(2, 0, 2, 0))), \
+                               _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(v[0]), _mm_castsi128_ps(v[1]), _MM_SHUFFLE(3, 1, 3, 1))))
+    rb[0] = PAIRS(rb);
+    ga[0] = PAIRS(ga);
+#undef PAIRS
+    su = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rb[0], cu_rb), _mm_madd_epi16(ga[0], cu_ga)), v512);
+    sv = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rb[0], cv_rb), _mm_madd_epi16(ga[0], cv_ga)), v512);
+    a4 = _mm_srli_epi32(ga[0], 16);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(a4, opaque)) != 0xffff) {
+      __m128i a = _mm_srli_epi32(_mm_add_epi32(a4, v2), 2);
+      a = _mm_sub_epi32(v256, _mm_add_epi32(a, _mm_srli_epi32(a, 7)));
+      if (f->format == YUV_NV12) {
+        __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)chroma_u(f, cx + i, cy)), zero);
+        du = _mm_and_si128(uv, lo16);
+        dv = _mm_srli_epi32(uv, 16);
+      } else {
+        int u4, v4;
+        memcpy(&u4, chroma_u(f, cx + i, cy), 4);
+        memcpy(&v4, chroma_v(f, cx + i, cy), 4);
+        du = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(u4), zero), zero);
+        dv = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v4), zero), zero);
+      }
+      su = _mm_add_epi32(_mm_slli_epi32(_mm_mullo_epi16(du, a), 2), su);
+      sv = _mm_add_epi32(_mm_slli_epi32(_mm_mullo_epi16(dv, a), 2), sv);
+    }
+    du = _mm_packus_epi16(_mm_packs_epi32(_mm_srai_epi32(su, 10), _mm_srai_epi32(sv, 10)), zero); /* u0..u3 v0..v3 */
+    if (f->format == YUV_NV12) {
+      _mm_storel_epi64((__m128i*)chroma_u(f, cx + i, cy), _mm_unpacklo_epi8(du, _mm_srli_si128(du, 4)));
+    } else {
+      int u4 = _mm_cvtsi128_si32(du), v4 = _mm_cvtsi128_si32(_mm_srli_si128(du, 4));
+      memcpy(chroma_u(f, cx + i, cy), &u4, 4);
+      memcpy(chroma_v(f, cx + i, cy), &v4, 4);
+    }
+  }
+#elif defined(YUV_NEON)
+  int16x4_t cu[3], cv[3];
+  for (int k = 0; k < 3; k++) { cu[k] = vdup_n_s16((int16_t)m[1][k]); cv[k] = vdup_n_s16((int16_t)m[2][k]); }
+  for (; i + 8 <= n; i += 8) {
+    uint8x16x4_t q0 = vld4q_u8(p0 + 8 * i), q1 = vld4q_u8(p1 + 8 * i);
+    uint16x8_t sum[4], a;
+    uint8x8_t out[2];
+    for (int k = 0; k < 4; k++) { sum[k] = vaddq_u16(vpaddlq_u8(q0.val[k]), vpaddlq_u8(q1.val[k])); }
+    a = vshrq_n_u16(vaddq_u16(sum[3], vdupq_n_u16(2)), 2);
+    a = vsubq_u16(vdupq_n_u16(256), vsraq_n_u16(a, a, 7));
+    uint8x8x2_t d;
+    if (f->format == YUV_NV12) {
+      d = vld2_u8(chroma_u(f, cx + i, cy));
+    } else {
+      d.val[0] = vld1_u8(chroma_u(f, cx + i, cy));
+      d.val[1] = vld1_u8(chroma_v(f, cx + i, cy));
+    }
+    for (int c = 0; c < 2; c++) {
+      const int16x4_t *k = c ? cv : cu;
+      uint16x8_t dc = vmovl_u8(d.val[c]);
+      int32x4_t s[2];
+      for (int h = 0; h < 2; h++) {
+        int16x4_t r = vreinterpret_s16_u16(h ? vget_high_u16(sum[0]) : vget_low_u16(sum[0]));
+        int16x4_t g = vreinterpret_s16_u16(h ? vget_high_u16(sum[1]) : vget_low_u16(sum[1]));
+        int16x4_t b = vreinterpret_s16_u16(h ? vget_high_u16(sum[2]) : vget_low_u16(sum[2]));
+        int16x4_t a4 = vreinterpret_s16_u16(h ? vget_high_u16(sum[3]) : vget_low_u16(sum[3]));
+        uint32x4_t t = vmull_u16(h ? vget_high_u16(dc) : vget_low_u16(dc), h ? vget_high_u16(a) : vget_low_u16(a));
+        s[h] = vaddq_s32(vshlq_n_s32(vreinterpretq_s32_u32(t), 2), vdupq_n_s32(512));
+        s[h] = vmlal_s16(vmlal_s16(vmlal_s16(vmlal_s16(s[h], r, k[0]), g, k[1]), b, k[2]), a4, vdup_n_s16(128));
+        s[h] = vshrq_n_s32(s[h], 10);
+      }
+      out[c] = vqmovn_u16(vcombine_u16(vqmovun_s32(s[0]), vqmovun_s32(s[1])));
+    }
+    if (f->format == YUV_NV12) {
+      uint8x8x2_t uv = { { out[0], out[1] } };
+      vst2_u8(chroma_u(f, cx + i, cy), uv);
+    } else {
+      vst1_u8(chroma_u(f, cx + i, cy), out[0]);
+      vst1_u8(chroma_v(f, cx + i, cy), out[1]);
+    }
+  }
+#endif
+  for (; i < n; i++) { blend_rgba_block(f, cx + i, cy, p0 + 8 * i, p1 + 8 * i, 2, m); }
+}
+
+/* r.w * r.h premultiplied pixels, row k at rgba + k * pitch, into r (already clipped) */
+static void blend_rgba(const yuv_Frame *f, mu_Rect r, const unsigned char *rgba, int pitch) {
+  const int (*m)[3] = matrix(f);
+  int x1 = r.x + r.w, y1 = r.y + r.h;
+  if (r.w <= 0 || r.h <= 0) { return; }
+  for (int y = r.y; y < y1; y++) {
+    blend_rgba_luma(f->y + y * f->y_stride + r.x, rgba + (y - r.y) * pitch, r.w, m[0]);
+  }
+  for (int cy = r.y >> 1; cy < (y1 + 1) >> 1; cy++) {
+    const unsigned char *p0 = 2 * cy >= r.y ? rgba + (2 * cy - r.y) * pitch : NULL;
+    const unsigned char *p1 = 2 * cy + 1 < y1 ? rgba + (2 * cy + 1 - r.y) * pitch : NULL;
+    int x = r.x, n;
+    if (x & 1) {
+      blend_rgba_block(f, x >> 1, cy, p0, p1, 1, m);
+      x++;
+    }
+    n = (x1 - x) >> 1;
+    if (p0 && p1) {
+      blend_rgba_chroma(f, x >> 1, cy, p0 + 4 * (x - r.x), p1 + 4 * (x - r.x), n, m);
+    } else {
+      for (int i = 0; i < n; i++) {
+        blend_rgba_block(f, (x >> 1) + i, cy, p0 ? p0 + 4 * (x - r.x + 2 * i) : NULL, p1 ? p1 + 4 * (x - r.x + 2 * i) : NULL, 2, m);
+      }
+    }
+    x += 2 * n;
+    if (x < x1) {
+      blend_rgba_block(f, x >> 1, cy, p0 ? p0 + 4 * (x - r.x) : NULL, p1 ? p1 + 4 * (x - r.x) : NULL, 1, m);
+    }
+  }
+}
+
+
+/* ---- commands ---- */
+
+/* columns a rounded corner of radius r cuts off in row y, 0 being the edge */
+static int corner_inset(int r, int y) {
+  int dy = 2 * (r - y) - 1; /* half pixels from the corner's center */
+  int x = 0;
+  if (y >= r) { return 0; }
+  while (x < r && (2 * (r - x) - 1) * (2 * (r - x) - 1) + dy * dy > 4 * r * r) { x++; }
+  return x;
+}
+
+static void box_span(const yuv_Frame *f, mu_Rect clip, mu_Rect rect, int x0, int x1, int y, int h, Yuva c) {
+  if (x1 > x0 && h > 0 && c.a) { blend_rect(f, intersect_rects(mu_rect(rect.x + x0, y, x1 - x0, h), clip), c); }
+}
+
+/* rows [y, y + h) of a box, all of them at distance `edge` from its nearest edge */
+static void box_rows(const yuv_Frame *f, mu_Rect clip, mu_Rect rect, int y, int h, int edge, Yuva c, Yuva border, int b, int r) {
+  int outer = corner_inset(r, edge);
+  int inner;
+  if (edge < b) {
+    box_span(f, clip, rect, outer, rect.w - outer, y, h, border);
+    return;
+  }
+  inner = b + corner_inset(mu_max(r - b, 0), edge - b);
+  box_span(f, clip, rect, outer, inner, y, h, border);
+  box_span(f, clip, rect, inner, rect.w - inner, y, h, c);
+  box_span(f, clip, rect, rect.w - inner, rect.w - outer, y, h, border);
+}
+
+/* the same spans the GL renderers draw */
+static void draw_box(const yuv_Frame *f, mu_Rect clip, mu_BoxCommand *cmd, mu_Vec2 offset) {
+  mu_Rect rect = mu_rect(cmd->rect.x + offset.x, cmd->rect.y + offset.y, cmd->rect.w, cmd->rect.h);
+  Yuva c = convert(f, cmd->color), border = convert(f, cmd->border_color);
+  int b = cmd->border;
+  int r = mu_max(mu_min(cmd->radius, mu_min(rect.w, rect.h) / 2), 0);
+  int rows = mu_min(mu_max(r, b), (rect.h + 1) / 2);
+  if (!intersect_rects(rect, clip).w) { return; }
+  for (int y = 0; y < rows; y++) {
+    box_rows(f, clip, rect, rect.y + y, 1, y, c, border, b, r);
+    if (rect.h - 1 - y != y) { box_rows(f, clip, rect, rect.y + rect.h - 1 - y, 1, y, c, border, b, r); }
+  }
+  box_rows(f, clip, rect, rect.y + rows, rect.h - 2 * rows, rows, c, border, b, r);
+}
+
+static void draw_text(const yuv_Frame *f, mu_Rect clip, mu_TextCommand *cmd, mu_Vec2 offset) {
+  Yuva c = convert(f, cmd->color);
+  int x = cmd->pos.x + offset.x, y = cmd->pos.y + offset.y;
+  if (sdf_is_face(cmd->font) && sdf_ready(((sdf_Face*)cmd->font)->font)) {
+    const sdf_Face *face = cmd->font;
+    int w = (int)sdf_text_width(face, cmd->str, cmd->len) + 1, h = sdf_line_height(face);
+    unsigned char *coverage;
+    if (!intersect_rects(mu_rect(x, y, w, h), clip).w) { return; }
+    if (!(coverage = grow_scratch((size_t)w * h))) { return; }
+    sdf_render(face, cmd->str, cmd->len, coverage, w, h);
+    blend_mask(f, clip, x, y, coverage, w, h, w, c);
+    return;
+  }
+  for (const char *p = cmd->str; p < cmd->str + cmd->len; p++) {
+    mu_Rect src;
+    if ((*p & 0xc0) == 0x80) { continue; }
+    src = atlas[ATLAS_FONT + mu_min((unsigned char) *p, 127)];
+    blend_mask(f, clip, x, y, atlas_texture + src.y * ATLAS_WIDTH + src.x, src.w, src.h, ATLAS_WIDTH, c);
+    x += src.w;
+  }
+}
+
+static void draw_icon(const yuv_Frame *f, mu_Rect clip, mu_IconCommand *cmd, mu_Vec2 offset) {
+  mu_Rect src = atlas[cmd->id];
+  int x = cmd->rect.x + offset.x + (cmd->rect.w - src.w) / 2;
+  int y = cmd->rect.y + offset.y + (cmd->rect.h - src.h) / 2;
+  blend_mask(f, clip, x, y, atlas_texture + src.y * ATLAS_WIDTH + src.x, src.w, src.h, ATLAS_WIDTH, convert(f, cmd->color));
+}
+
+/* the least recently drawn copy not drawn in this call goes */
+static int evict_copy(void) {
+  ImageCopy *lru = NULL;
+  for (int i = 0; i < IMG_MAX_IMAGES; i++) {
+    ImageCopy *c = &copies[i];
+    if (!c->pixels || c->last_used == draw_count) { continue; }
+    if (!lru || c->last_used < lru->last_used) { lru = c; }
+  }
+  if (!lru) { return 0; }
+  free(lru->pixels);
+  lru->pixels = NULL;
+  copy_bytes -= (long)lru->w * lru->h * 4;
+  return 1;
+}
+
+/* copies the decoded image at w x h, never larger than it is, and gives the
+ * decoded pixels back; 0 while it is decoding or the copy does not fit */
+static int copy_image(img_Image *image, ImageCopy *c, int w, int h) {
+  const unsigned char *src;
+  unsigned char *p;
+  long size;
+  int sw, sh;
+  if (!c->held) {
+    img_hold(image);
+    c->held = 1;
+    holding[holding_count++] = image;
+  }
+  if (img_request(image) != IMG_DECODED || !(src = img_pixels(image, &sw, &sh))) { return 0; }
+  w = mu_min(w, sw);
+  h = mu_min(h, sh);
+  size = (long)w * h * 4;
+  while (copy_bytes + size > image_budget) {
+    if (!evict_copy()) {
+      if (copy_bytes > 0) { return 0; }
+      break; /* larger than the budget alone */
+    }
+  }
+  if (!(p = malloc(size))) { return 0; }
+  for (int y = 0; y < h; y++) {
+    const unsigned char *row = src + (size_t)(y * sh / h) * sw * 4;
+    for (int x = 0; x < w; x++) { memcpy(p + ((size_t)y * w + x) * 4, row + (size_t)(x * sw / w) * 4, 4); }
+  }
+  if (c->pixels) {
+    free(c->pixels);
+    copy_bytes -= (long)c->w * c->h * 4;
+  }
+  c->pixels = p;
+  c->w = w;
+  c->h = h;
+  c->src_w = sw;
+  c->src_h = sh;
+  copy_bytes += size;
+  img_release(image);
+  c->held = 0;
+  return 1;
+}
+
+/* gives back the decoded pixels of images that failed, or went out of view
+ * before they were copied */
+static void release_images(void) {
+  for (int i = 0; i < holding_count; ) {
+    ImageCopy *c = &copies[img_index(holding[i])];
+    if (c->held && c->last_used == draw_count && img_state(holding[i]) != IMG_FAILED) {
+      i++;
+      continue;
+    }
+    if (c->held) {
+      img_release(holding[i]);
+      c->held = 0;
+    }
+    holding[i] = holding[--holding_count];
+  }
+}
+
+/* nearest-neighbour scaled from its copy into the scratch buffer, then
+ * blended like a layer; nothing until the image is decoded once. A copy
+ * smaller than the image is made again when the image is drawn larger */
+static void draw_image(const yuv_Frame *f, mu_Rect clip, mu_ImageCommand *cmd, mu_Vec2 offset) {
+  mu_Rect rect = mu_rect(cmd->rect.x + offset.x, cmd->rect.y + offset.y, cmd->rect.w, cmd->rect.h);
+  mu_Rect r = intersect_rects(rect, clip);
+  ImageCopy *c;
+  unsigned char *dst;
+  int w, h, fade = cmd->color.a + (cmd->color.a >> 7);
+  if (!cmd->image || !r.w || !r.h || !fade) { return; }
+  c = &copies[img_index(cmd->image)];
+  c->last_used = draw_count;
+  if (!c->pixels || (rect.w > c->w && c->w < c->src_w) || (rect.h > c->h && c->h < c->src_h)) {
+    if (!copy_image(cmd->image, c, rect.w, rect.h) && !c->pixels) { return; }
+  }
+  w = c->w;
+  h = c->h;
+  if (!(dst = grow_scratch((size_t)r.w * r.h * 4))) { return; }
+  for (int y = 0; y < r.h; y++) {
+    const unsigned char *row = c->pixels + (size_t)((r.y + y - rect.y) * h / rect.h) * w * 4;
+    unsigned char *out = dst + (size_t)y * r.w * 4;
+    for (int x = 0; x < r.w; x++, out += 4) {
+      const unsigned char *p = row + (size_t)((r.x + x - rect.x) * w / rect.w) * 4;
+      if (fade == 256) { memcpy(out, p, 4); continue; }
+      for (int k = 0; k < 4; k++) { out[k] = (p[k] * fade) >> 8; }
+    }
+  }
+  blend_rgba(f, r, dst, r.w * 4);
+}
+
+/// Blends a frame's commands into a YUV frame, clipped to it. Layers are
+/// drawn through, as by a renderer without offscreen targets.
+void yuv_draw_commands(const yuv_Frame *frame, mu_CommandList *list) {
+  mu_Rect bound = mu_rect(0, 0, frame->width, frame->height), clip = bound;
+  mu_Rect stack[CLIP_STACK_SIZE][2];
+  mu_Vec2 offset = mu_vec2(0, 0);
+  int depth = 0;
+  mu_Command *cmd = NULL;
+  draw_count++;
+  while (mu_next_command_ex(list, &cmd)) {
+    switch (cmd->type) {
+      case MU_COMMAND_RECT: {
+        mu_Rect r = mu_rect(cmd->rect.rect.x + offset.x, cmd->rect.rect.y + offset.y, cmd->rect.rect.w, cmd->rect.rect.h);
+        blend_rect(frame, intersect_rects(r, clip), convert(frame, cmd->rect.color));
+        break;
+      }
+      case MU_COMMAND_BOX: draw_box(frame, clip, &cmd->box, offset); break;
+      case MU_COMMAND_TEXT: draw_text(frame, clip, &cmd->text, offset); break;
+      case MU_COMMAND_ICON: draw_icon(frame, clip, &cmd->icon, offset); break;
+      case MU_COMMAND_IMAGE: draw_image(frame, clip, &cmd->image, offset); break;
+      case MU_COMMAND_CLIP: {
+        mu_Rect r = mu_rect(cmd->clip.rect.x + offset.x, cmd->clip.rect.y + offset.y, cmd->clip.rect.w, cmd->clip.rect.h);
+        clip = intersect_rects(r, bound);
+        break;
+      }
+      case MU_COMMAND_TRANSLATE:
+        offset.x += cmd->translate.offset.x;
+        offset.y += cmd->translate.offset.y;
+        break;
+      case MU_COMMAND_LAYER: {
+        mu_Rect r = mu_rect(cmd->layer.clip.x + offset.x, cmd->layer.clip.y + offset.y, cmd->layer.clip.w, cmd->layer.clip.h);
+        assert(depth < CLIP_STACK_SIZE);
+        stack[depth][0] = clip;
+        stack[depth][1] = bound;
+        depth++;
+        bound = intersect_rects(r, bound);
+        clip = bound;
+        break;
+      }
+      case MU_COMMAND_LAYER_END:
+        assert(depth > 0);
+        depth--;
+        clip = stack[depth][0];
+        bound = stack[depth][1];
+        break;
+    }
+  }
+  release_images();
+}
+
+/// Limits the bytes held by scaled image copies, evicting the least recently
+/// drawn.
+void yuv_set_image_budget(int bytes) {
+  image_budget = bytes;
+  while (copy_bytes > image_budget && evict_copy()) {}
+}
+
+
+/* ---- layers ---- */
+
+static int tile_covered(const yuv_Layer *layer, int tx, int ty) {
+  int x0 = tx * YUV_TILE, x1 = mu_min(x0 + YUV_TILE, layer->w);
+  int y0 = ty * YUV_TILE, y1 = mu_min(y0 + YUV_TILE, layer->h);
+  for (int y = y0; y < y1; y++) {
+    const unsigned char *p = layer->rgba + (size_t)y * layer->stride + 4 * x0 + 3;
+    for (int x = x0; x < x1; x++, p += 4) {
+      if (*p) { return 1; }
+    }
+  }
+  return 0;
+}
+
+/// Starts tracking the w * h premultiplied pixels at rgba, which the caller
+/// keeps. Every tile is scanned once here.
+void yuv_layer_init(yuv_Layer *layer, const unsigned char *rgba, int stride, int w, int h) {
+  layer->rgba = rgba;
+  layer->stride = stride;
+  layer->w = mu_min(w, YUV_MAX_TILES_X * YUV_TILE);
+  layer->h = mu_min(h, YUV_MAX_TILES_Y * YUV_TILE);
+  memset(layer->tiles, 0, sizeof(layer->tiles));
+  yuv_layer_damage(layer, mu_rect(0, 0, layer->w, layer->h));
+}
+
+/// Rescans the tiles under rect after the caller redrew it.
+void yuv_layer_damage(yuv_Layer *layer, mu_Rect rect) {
+  rect = intersect_rects(rect, mu_rect(0, 0, layer->w, layer->h));
+  if (!rect.w || !rect.h) { return; }
+  for (int ty = rect.y / YUV_TILE; ty <= (rect.y + rect.h - 1) / YUV_TILE; ty++) {
+    for (int tx = rect.x / YUV_TILE; tx <= (rect.x + rect.w - 1) / YUV_TILE; tx++) {
+      layer->tiles[ty][tx] = tile_covered(layer, tx, ty);
+    }
+  }
+}
+
+/// @return The tiles with coverage, the ones yuv_blend_layer touches.
+int yuv_layer_tiles(const yuv_Layer *layer) {
+  int count = 0;
+  for (int ty = 0; ty < YUV_MAX_TILES_Y; ty++) {
+    for (int tx = 0; tx < YUV_MAX_TILES_X; tx++) { count += layer->tiles[ty][tx]; }
+  }
+  return count;
+}
+
+/// Blends the covered tiles of a layer with its top left at (x, y), rounded
+/// down to even so no chroma sample is shared by two tiles. Each run of
+/// covered tiles in a row is blended as one rect.
+void yuv_blend_layer(const yuv_Frame *frame, const yuv_Layer *layer, int x, int y) {
+  mu_Rect bound = mu_rect(0, 0, frame->width, frame->height);
+  int tiles_x = (layer->w + YUV_TILE - 1) / YUV_TILE, tiles_y = (layer->h + YUV_TILE - 1) / YUV_TILE;
+  x &= ~1;
+  y &= ~1;
+  for (int ty = 0; ty < tiles_y; ty++) {
+    for (int tx = 0; tx < tiles_x; ) {
+      int end = tx;
+      mu_Rect run, r;
+      if (!layer->tiles[ty][tx]) { tx++; continue; }
+      while (end < tiles_x && layer->tiles[ty][end]) { end++; }
+      run = mu_rect(tx * YUV_TILE, ty * YUV_TILE, (end - tx) * YUV_TILE, YUV_TILE);
+      run = intersect_rects(run, mu_rect(0, 0, layer->w, layer->h));
+      r = intersect_rects(mu_rect(run.x + x, run.y + y, run.w, run.h), bound);
+      blend_rgba(frame, r, layer->rgba + (size_t)(r.y - y) * layer->stride + 4 * (r.x - x), layer->stride);
+      tx = end;
+    }
+  }
+}
+
+/// @return Which row kernels were compiled in: "sse2", "neon" or "scalar".
+const char *yuv_kernels(void) {
+#if defined(YUV_SSE2)
+  return "sse2";
+#elif defined(YUV_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}